@@ -0,0 +1,85 @@
+// benbaker76 (https://github.com/benbaker76)
+//
+// Minimal Arduino core for building the firmware natively in ymrender.
+// Only what YMPlayerSerial, YM2149 and DigiDrum use is provided.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <type_traits>
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+
+#define A0 18
+#define A1 19
+#define A2 20
+#define A3 21
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define _NOP() ((void)0)
+#define __builtin_avr_delay_cycles(n) ((void)(n))
+#define noInterrupts() ((void)0)
+#define interrupts() ((void)0)
+#define constrain(a, lo, hi) ((a) < (lo) ? (lo) : ((a) > (hi) ? (hi) : (a)))
+
+template<class T, class U> typename std::common_type<T, U>::type min(T a, U b) { return a < b ? a : b; }
+template<class T, class U> typename std::common_type<T, U>::type max(T a, U b) { return a > b ? a : b; }
+
+// Simulated time, advanced by the renderer
+extern uint32_t simMicros;
+inline unsigned long micros() { return simMicros; }
+inline unsigned long millis() { return simMicros / 1000; }
+void yield();
+
+// Serial reads come from the packet the renderer is replaying
+class SimSerial
+{
+  public:
+    void begin(unsigned long) {}
+    void setTimeout(unsigned long) {}
+
+    void feed(const uint8_t *data, size_t length)
+    {
+        buffer = data;
+        remaining = length;
+    }
+
+    size_t available() const { return remaining; }
+
+    size_t readBytes(char *out, size_t length)
+    {
+        size_t n = length < remaining ? length : remaining;
+        memcpy(out, buffer, n);
+        buffer += n;
+        remaining -= n;
+        return n;
+    }
+
+    // Firmware output (reports) goes to stderr
+    void print(const char *s) { fputs(s, stderr); }
+    void print(unsigned long v) { fprintf(stderr, "%lu", v); }
+    void println(const char *s) { fprintf(stderr, "%s\n", s); }
+    void println(unsigned long v) { fprintf(stderr, "%lu\n", v); }
+    void println() { fputc('\n', stderr); }
+
+  private:
+    const uint8_t *buffer = nullptr;
+    size_t remaining = 0;
+};
+
+extern SimSerial Serial;
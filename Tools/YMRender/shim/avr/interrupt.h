@@ -0,0 +1,9 @@
+// benbaker76 (https://github.com/benbaker76)
+
+#pragma once
+
+#define ISR(vector, ...) extern "C" void vector(void)
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define cli() ((void)0)
+#define sei() ((void)0)
@@ -0,0 +1,106 @@
+// benbaker76 (https://github.com/benbaker76)
+//
+// I/O registers for the native build. Port writes are reported to the
+// renderer's bus model, which decodes the YM2149 bus protocol from them.
+
+#pragma once
+
+#include <stdint.h>
+
+void busChanged();
+
+class IoReg
+{
+  public:
+    constexpr IoReg(bool bus = false) : bus(bus) {}
+
+    operator uint8_t() const { return value; }
+
+    IoReg &operator=(unsigned v) { set(v); return *this; }
+    IoReg &operator|=(unsigned v) { set(value | v); return *this; }
+    IoReg &operator&=(unsigned v) { set(value & v); return *this; }
+    IoReg &operator^=(unsigned v) { set(value ^ v); return *this; }
+
+    uint8_t value = 0;
+
+  private:
+    void set(unsigned v)
+    {
+        value = (uint8_t)v;
+        if (bus)
+            busChanged();
+    }
+
+    bool bus;
+};
+
+class IoReg16
+{
+  public:
+    operator uint16_t() const { return value; }
+    IoReg16 &operator=(unsigned v) { value = (uint16_t)v; return *this; }
+
+    uint16_t value = 0;
+};
+
+// Input pins read whatever the renderer's bus model drives
+uint8_t pinRead(char port);
+
+class PinReg
+{
+  public:
+    constexpr PinReg(char port) : port(port) {}
+    operator uint8_t() const { return pinRead(port); }
+
+  private:
+    char port;
+};
+
+extern IoReg PORTB, PORTC, PORTD, PORTE, PORTF;
+extern const PinReg PINB, PINC, PIND, PINE, PINF;
+extern IoReg DDRB, DDRC, DDRD, DDRE, DDRF;
+extern IoReg TCCR1A, TCCR1B, TIMSK1, TCCR3A, TCCR3B, TIMSK3;
+extern IoReg16 OCR1A, OCR3A;
+
+// Counters and flags are only read (by IsrProfile), through pointers
+extern volatile uint16_t TCNT1, TCNT3;
+extern volatile uint8_t TIFR1, TIFR3;
+
+#define _BV(b) (1 << (b))
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC6 6
+#define PC7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+#define PE6 6
+#define PF0 0
+#define PF1 1
+#define PF4 4
+#define PF5 5
+#define PF6 6
+#define PF7 7
+
+#define WGM12 3
+#define WGM32 3
+#define CS10 0
+#define CS11 1
+#define CS30 0
+#define CS31 1
+#define OCIE1A 1
+#define OCIE3A 1
+#define OCF1A 1
+#define OCF3A 1
@@ -0,0 +1,12 @@
+// benbaker76 (https://github.com/benbaker76)
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define pgm_read_byte(a) (*(const uint8_t *)(a))
+#define pgm_read_word(a) (*(const uint16_t *)(a))
+#define pgm_read_ptr(a) (*(void * const *)(a))
+#define memcpy_P memcpy
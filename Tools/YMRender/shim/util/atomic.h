@@ -0,0 +1,8 @@
+// benbaker76 (https://github.com/benbaker76)
+
+#pragma once
+
+// The renderer is single threaded, interrupts are run between calls
+#define ATOMIC_BLOCK(type) for (int _atomic = 1; _atomic; _atomic = 0)
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
@@ -0,0 +1,555 @@
+// benbaker76 (https://github.com/benbaker76)
+//
+// ymrender - run the YMPlayerSerial firmware natively against a packet
+// capture and log every YM2149 register write it makes.
+//
+//   ymrender render <capture> [-o writes.log] [--wav out.wav]
+//                   [--seconds N] [--clock Hz]
+//   ymrender diff <a.log> <b.log> [--tolerance-us N]
+//
+// Captures come from "YMPlayer --capture <file>", which writes the exact
+// packets the player would send with their frame times. The firmware's
+// port writes are decoded back into register writes by a model of the
+// BC1/BDIR bus, so YM2149.cpp is exercised too. Timers are simulated
+// whenever the firmware enables them: Timer1, the effects interrupt that
+// owns the bus and drains the firmware's write ring, and Timer3
+// (autonomous playback).
+//
+// Write times are simulated microseconds; all writes made by one
+// interrupt share its time. diff compares the writes to each chip
+// register in order, so reordering across registers is not a difference.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "YMPlayerSerial.h"
+
+uint32_t simMicros = 0;
+SimSerial Serial;
+
+IoReg PORTB(true), PORTC(true), PORTD(true), PORTE(true), PORTF(true);
+IoReg DDRB, DDRC, DDRD, DDRE, DDRF;
+const PinReg PINB('B'), PINC('C'), PIND('D'), PINE('E'), PINF('F');
+IoReg TCCR1A, TCCR1B, TIMSK1, TCCR3A, TCCR3B, TIMSK3;
+IoReg16 OCR1A, OCR3A;
+volatile uint16_t TCNT1, TCNT3;
+volatile uint8_t TIFR1, TIFR3;
+
+static YMPlayerSerial ymPlayer;
+
+struct Write
+{
+    uint32_t time;
+    uint8_t chip;
+    uint8_t reg;
+    uint8_t value;
+};
+
+static std::vector<Write> writes;
+
+// ──────────────────────────────────────────────────────────────────────────
+// Bus model: the YM2149 latches on the falling edge of BDIR, an address
+// when BC1 is high and data when it is low. With BC1 high and BDIR low
+// the selected chip drives the latched register onto the data bus.
+// ──────────────────────────────────────────────────────────────────────────
+static bool lastBdir = false;
+static uint8_t latched[8];
+static uint8_t chipRegs[3][16];
+
+static uint8_t dataBus()
+{
+    uint8_t d = PORTD, c = PORTC, e = PORTE, b = PORTB;
+    return ((d >> PD1) & 1) << 0 |
+           ((d >> PD0) & 1) << 1 |
+           ((d >> PD4) & 1) << 2 |
+           ((c >> PC6) & 1) << 3 |
+           ((d >> PD7) & 1) << 4 |
+           ((e >> PE6) & 1) << 5 |
+           ((b >> PB4) & 1) << 6 |
+           ((b >> PB5) & 1) << 7;
+}
+
+static uint8_t selectedChip()
+{
+    uint8_t f = PORTF;
+    uint8_t sel = ((f >> PF4) & 1) | ((f >> PF6) & 1) << 1 | ((f >> PF7) & 1) << 2;
+    return 2 - sel;     // selectYM() drives 2 - chip, other values select nothing
+}
+
+void busChanged()
+{
+    bool bdir = PORTF & _BV(PF5);
+
+    if (lastBdir && !bdir)
+    {
+        uint8_t chip = selectedChip();
+
+        if (chip < 3)
+        {
+            if (PORTB & _BV(PB6))
+                latched[chip] = dataBus();
+            else if (latched[chip] < 16)
+            {
+                chipRegs[chip][latched[chip]] = dataBus();
+                writes.push_back({ simMicros, chip, latched[chip], dataBus() });
+            }
+        }
+    }
+
+    lastBdir = bdir;
+}
+
+uint8_t pinRead(char port)
+{
+    uint8_t out = 0, ddr = 0, driven = 0;
+    switch (port)
+    {
+        case 'B': out = PORTB; ddr = DDRB; break;
+        case 'C': out = PORTC; ddr = DDRC; break;
+        case 'D': out = PORTD; ddr = DDRD; break;
+        case 'E': out = PORTE; ddr = DDRE; break;
+    }
+
+    uint8_t chip = selectedChip();
+    bool reading = (PORTB & _BV(PB6)) && !(PORTF & _BV(PF5));
+    if (!reading || chip >= 3 || latched[chip] >= 16)
+        return out;
+
+    uint8_t v = chipRegs[chip][latched[chip]];
+    switch (port)
+    {
+        case 'B': driven = (v >> 6 & 1) << PB4 | (v >> 7 & 1) << PB5; break;
+        case 'C': driven = (v >> 3 & 1) << PC6; break;
+        case 'D': driven = (v & 1) << PD1 | (v >> 1 & 1) << PD0 |
+                           (v >> 2 & 1) << PD4 | (v >> 4 & 1) << PD7; break;
+        case 'E': driven = (v >> 5 & 1) << PE6; break;
+    }
+
+    // Output pins read back what they drive
+    return (out & ddr) | (driven & ~ddr);
+}
+
+// ──────────────────────────────────────────────────────────────────────────
+// Playback
+// ──────────────────────────────────────────────────────────────────────────
+struct Packet
+{
+    uint32_t time;
+    std::vector<uint8_t> data;
+};
+
+static bool loadCapture(const char *path, std::vector<Packet> &packets)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    char magic[4];
+    bool ok = fread(magic, 1, 4, f) == 4 && !memcmp(magic, "YMCP", 4);
+
+    uint8_t head[6];
+    while (ok && fread(head, 1, 6, f) == 6)
+    {
+        Packet p;
+        p.time = head[0] | head[1] << 8 | head[2] << 16 | (uint32_t)head[3] << 24;
+        p.data.resize(head[4] | head[5] << 8);
+        ok = fread(p.data.data(), 1, p.data.size(), f) == p.data.size();
+        packets.push_back(std::move(p));
+    }
+
+    fclose(f);
+    return ok;
+}
+
+static uint32_t nextEffects = 0;
+static uint32_t nextSong = 0;
+static bool songTimerWasOn = false;
+static bool effectsTimerWasOn = false;
+
+static uint32_t effectsPeriod() { return (OCR1A + 1) / (F_CPU / 1000000); }
+
+// The firmware calls yield() while it waits for room in the bus ring or
+// the PCM ring, which only the effects interrupt frees. Runs the next
+// effects tick.
+void yield()
+{
+    if (!(TIMSK1 & _BV(OCIE1A)))
+    {
+        fprintf(stderr, "bus ring full with the effects timer off\n");
+        exit(1);
+    }
+
+    if (!effectsTimerWasOn)
+    {
+        nextEffects = simMicros + effectsPeriod();
+        effectsTimerWasOn = true;
+    }
+
+    if (simMicros < nextEffects)
+        simMicros = nextEffects;
+    ymPlayer.updateEffects();
+    nextEffects += effectsPeriod();
+}
+
+// Runs the interrupts that fall due up to time
+static void advanceTo(uint32_t time)
+{
+    for (;;)
+    {
+        bool effects = TIMSK1 & _BV(OCIE1A);
+
+        if (effects && !effectsTimerWasOn)
+            nextEffects = simMicros + effectsPeriod();
+        effectsTimerWasOn = effects;
+
+        bool songTimer = TIMSK3 & _BV(OCIE3A);
+        uint32_t songPeriod = (OCR3A + 1) * 64 / (F_CPU / 1000000);
+
+        if (songTimer && !songTimerWasOn)
+            nextSong = simMicros + songPeriod;
+        songTimerWasOn = songTimer;
+
+        uint32_t next = time;
+        if (effects && nextEffects < next)
+            next = nextEffects;
+        if (songTimer && nextSong < next)
+            next = nextSong;
+
+        if (next >= time)
+            break;
+
+        simMicros = next;
+
+        if (effects && nextEffects == next)
+        {
+            ymPlayer.updateEffects();
+            nextEffects += effectsPeriod();
+        }
+        if (songTimer && nextSong == next)
+        {
+            ymPlayer.updateSong();
+            nextSong += songPeriod;
+        }
+    }
+
+    // yield() may have run ahead
+    if (simMicros < time)
+        simMicros = time;
+}
+
+// ──────────────────────────────────────────────────────────────────────────
+// Audio: a plain YM2149 model (32 step envelope and volume), good enough
+// to hear what a change did, not a reference emulator.
+// ──────────────────────────────────────────────────────────────────────────
+struct Psg
+{
+    uint8_t regs[16] = {};
+    uint32_t toneCount[3] = {};
+    bool tone[3] = {};
+    uint32_t noiseCount = 0;
+    uint32_t lfsr = 1;
+    bool noise = false;
+    uint32_t envCount = 0;
+    int envStep = 0;
+    bool envAttack = false;
+    bool envHold = false;
+
+    void write(uint8_t r, uint8_t v)
+    {
+        regs[r] = v;
+        if (r == 13)
+        {
+            envStep = 0;
+            envHold = false;
+            envAttack = v & 0x04;
+        }
+    }
+
+    // One tick is 8 master clocks
+    void tick()
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t period = regs[c * 2] | (regs[c * 2 + 1] & 0x0F) << 8;
+            if (++toneCount[c] >= (period ? period : 1))
+            {
+                toneCount[c] = 0;
+                tone[c] = !tone[c];
+            }
+        }
+
+        uint32_t noisePeriod = regs[6] & 0x1F;
+        if (++noiseCount >= 2 * (noisePeriod ? noisePeriod : 1))
+        {
+            noiseCount = 0;
+            lfsr = (lfsr >> 1) | (((lfsr ^ (lfsr >> 3)) & 1) << 16);
+            noise = lfsr & 1;
+        }
+
+        uint32_t envPeriod = regs[11] | regs[12] << 8;
+        if (++envCount >= (envPeriod ? envPeriod : 1))
+        {
+            envCount = 0;
+            stepEnvelope();
+        }
+    }
+
+    void stepEnvelope()
+    {
+        if (envHold || ++envStep < 32)
+            return;
+
+        uint8_t shape = regs[13];
+        envStep = 0;
+
+        if (!(shape & 0x08))
+        {
+            envHold = true;
+            envAttack = false;
+            envStep = 31;           // level 0
+        }
+        else if (shape & 0x01)
+        {
+            envHold = true;
+            bool high = ((shape >> 2) ^ (shape >> 1)) & 1;
+            envAttack = high;
+            envStep = 31;
+        }
+        else if (shape & 0x02)
+        {
+            envAttack = !envAttack;
+        }
+    }
+
+    int envLevel() const { return envAttack ? envStep : 31 - envStep; }
+
+    double output(const double *amp) const
+    {
+        double sum = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            bool toneOn = tone[c] || (regs[7] & (1 << c));
+            bool noiseOn = noise || (regs[7] & (8 << c));
+            if (!(toneOn && noiseOn))
+                continue;
+
+            uint8_t level = regs[8 + c];
+            sum += amp[(level & 0x10) ? envLevel() : (level & 0x0F) * 2 + 1];
+        }
+        return sum;
+    }
+};
+
+static void put32(FILE *f, uint32_t v) { fwrite(&v, 4, 1, f); }
+static void put16(FILE *f, uint16_t v) { fwrite(&v, 2, 1, f); }
+
+static bool renderWav(const char *path, uint32_t endTime, uint32_t clock)
+{
+    const uint32_t rate = 44100;
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    double amp[32];
+    amp[0] = 0;
+    for (int i = 1; i < 32; i++)
+        amp[i] = pow(10.0, -(31 - i) * 1.5 / 20.0);
+
+    uint32_t samples = (uint64_t)endTime * rate / 1000000;
+
+    fwrite("RIFF", 1, 4, f);
+    put32(f, 36 + samples * 2);
+    fwrite("WAVEfmt ", 1, 8, f);
+    put32(f, 16);
+    put16(f, 1);
+    put16(f, 1);
+    put32(f, rate);
+    put32(f, rate * 2);
+    put16(f, 2);
+    put16(f, 16);
+    fwrite("data", 1, 4, f);
+    put32(f, samples * 2);
+
+    Psg psg[3];
+    size_t next = 0;
+    double ticks = 0, ticksPerSample = clock / 8.0 / rate;
+    std::vector<int16_t> out(samples);
+
+    for (uint32_t s = 0; s < samples; s++)
+    {
+        uint32_t now = (uint64_t)s * 1000000 / rate;
+        while (next < writes.size() && writes[next].time <= now)
+        {
+            psg[writes[next].chip].write(writes[next].reg, writes[next].value);
+            next++;
+        }
+
+        double acc = 0;
+        int n = 0;
+        for (ticks += ticksPerSample; ticks >= 1; ticks -= 1, n++)
+            for (auto &p : psg)
+            {
+                p.tick();
+                acc += p.output(amp);
+            }
+
+        double v = n ? acc / n / 9.0 : 0;
+        out[s] = (int16_t)(v * 30000);
+    }
+
+    fwrite(out.data(), 2, out.size(), f);
+    fclose(f);
+    return true;
+}
+
+static int render(int argc, char **argv)
+{
+    const char *capture = argv[0];
+    const char *logPath = "writes.log";
+    const char *wavPath = nullptr;
+    double extraSeconds = 0;
+    uint32_t clock = 2000000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) logPath = argv[++i];
+        else if (!strcmp(argv[i], "--wav") && i + 1 < argc) wavPath = argv[++i];
+        else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) extraSeconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--clock") && i + 1 < argc) clock = atoi(argv[++i]);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 2; }
+    }
+
+    std::vector<Packet> packets;
+    if (!loadCapture(capture, packets))
+    {
+        fprintf(stderr, "cannot read capture %s\n", capture);
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    ymPlayer.begin();
+
+    for (auto &p : packets)
+    {
+        advanceTo(p.time);
+        Serial.feed(p.data.data(), p.data.size());
+        while (Serial.available())
+            ymPlayer.update();
+    }
+
+    // Give the last frame's writes time to leave the bus ring
+    uint32_t endTime = simMicros + 2000 + (uint32_t)(extraSeconds * 1000000);
+    advanceTo(endTime);
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    FILE *log = fopen(logPath, "w");
+    if (!log)
+    {
+        fprintf(stderr, "cannot write %s\n", logPath);
+        return 2;
+    }
+    for (auto &w : writes)
+        fprintf(log, "%u %u %u %u\n", w.time, w.chip, w.reg, w.value);
+    fclose(log);
+
+    fprintf(stderr, "%zu packets, %zu writes, %.3f s simulated in %.3f s\n",
+            packets.size(), writes.size(), endTime / 1e6, elapsed);
+    fprintf(stderr, "%u chip selects, %.0f per second\n",
+            (unsigned)YM2149::selectCount, YM2149::selectCount / (endTime / 1e6));
+
+    if (wavPath && !renderWav(wavPath, endTime, clock))
+    {
+        fprintf(stderr, "cannot write %s\n", wavPath);
+        return 2;
+    }
+
+    return 0;
+}
+
+// ──────────────────────────────────────────────────────────────────────────
+// Diff
+// ──────────────────────────────────────────────────────────────────────────
+typedef std::map<int, std::vector<std::pair<uint32_t, int>>> WriteLog;
+
+static bool loadLog(const char *path, WriteLog &log)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    unsigned t, chip, reg, value;
+    while (fscanf(f, "%u %u %u %u", &t, &chip, &reg, &value) == 4)
+        log[chip * 16 + reg].push_back({ t, (int)value });
+
+    fclose(f);
+    return true;
+}
+
+static int diff(int argc, char **argv)
+{
+    uint32_t tolerance = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--tolerance-us") && i + 1 < argc) tolerance = atoi(argv[++i]);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 2; }
+    }
+
+    WriteLog a, b;
+    if (!loadLog(argv[0], a) || !loadLog(argv[1], b))
+    {
+        fprintf(stderr, "cannot read logs\n");
+        return 2;
+    }
+
+    long differences = 0;
+    const int maxShown = 20;
+
+    for (int key = 0; key < 3 * 16; key++)
+    {
+        auto &x = a[key];
+        auto &y = b[key];
+        size_t n = x.size() < y.size() ? x.size() : y.size();
+
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t dt = x[i].first > y[i].first ? x[i].first - y[i].first : y[i].first - x[i].first;
+            if (x[i].second == y[i].second && dt <= tolerance)
+                continue;
+
+            if (differences++ < maxShown)
+                printf("chip %d r%-2d write %zu: %u us = %d  vs  %u us = %d\n",
+                       key / 16, key % 16, i, x[i].first, x[i].second, y[i].first, y[i].second);
+        }
+
+        if (x.size() != y.size())
+        {
+            if (differences++ < maxShown)
+                printf("chip %d r%-2d: %zu writes vs %zu\n", key / 16, key % 16, x.size(), y.size());
+        }
+    }
+
+    printf("%ld difference%s\n", differences, differences == 1 ? "" : "s");
+    return differences ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && !strcmp(argv[1], "render"))
+        return render(argc - 2, argv + 2);
+
+    if (argc >= 4 && !strcmp(argv[1], "diff"))
+        return diff(argc - 2, argv + 2);
+
+    fprintf(stderr,
+            "usage: ymrender render <capture> [-o writes.log] [--wav out.wav] [--seconds N] [--clock Hz]\n"
+            "       ymrender diff <a.log> <b.log> [--tolerance-us N]\n");
+    return 2;
+}
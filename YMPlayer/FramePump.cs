@@ -8,45 +8,164 @@ using System.Threading.Tasks;
 
 namespace YMPlayer
 {
+    /// What to do when a frame is due more than one period late.
+    public enum CatchUpPolicy
+    {
+        Skip,       // drop the missed frames, tick once with the number elapsed
+        Burst,      // tick back to back for up to MaxBurst missed frames
+        Stretch     // restart the schedule from now, the tune slows down
+    }
+
     public class FramePump : IDisposable
     {
+        // Lateness histogram bucket upper bounds in µs, the last bucket is open
+        public static readonly int[] LatenessBucketsUs = { 50, 100, 250, 500, 1000, 2000, 5000 };
+
         private readonly Thread _thread;
         private readonly CancellationTokenSource _cts = new CancellationTokenSource();
-        private readonly int _framePeriodUs;
-        private readonly Action _tick;
+        private readonly long _framePeriodUs;
+        private readonly Action<int> _tick;
+        private readonly CatchUpPolicy _policy;
+        private readonly int _maxBurst;
+        private readonly long _maxSpinUs;
+
+        private readonly long[] _lateness = new long[LatenessBucketsUs.Length + 1];
+        private long _frames, _droppedFrames, _maxLatenessUs, _spinUs, _elapsedUs;
+        private long _spinWindowUs = 500;
+        private string _timerName;
 
-        public FramePump(int frameRate, Action tick)
+        /// tick receives the number of frames elapsed since the previous
+        /// call, which is 1 except when the Skip policy dropped frames.
+        /// cpuBudget is the fraction of one core the final spin may use.
+        public FramePump(int frameRate, Action<int> tick, CatchUpPolicy policy = CatchUpPolicy.Burst,
+                         int maxBurst = 3, double cpuBudget = 0.05)
         {
             _framePeriodUs = 1_000_000 / frameRate;   // 50 Hz -> 20 000 µs
             _tick = tick;
-            _thread = new Thread(Run) { Priority = ThreadPriority.Highest };
+            _policy = policy;
+            _maxBurst = Math.Max(1, maxBurst);
+            _maxSpinUs = (long)(_framePeriodUs * Math.Clamp(cpuBudget, 0.0, 1.0));
+            _thread = new Thread(Run) { Priority = ThreadPriority.Highest, IsBackground = true };
             _thread.Start();
         }
 
+        private static long NowUs(Stopwatch sw) => sw.ElapsedTicks * 1_000_000 / Stopwatch.Frequency;
+
         private void Run()
         {
+            using var timer = FrameTimer.Create();
+            _timerName = timer.Name;
+
             var sw = Stopwatch.StartNew();
             long nextUs = 0;
 
             while (!_cts.IsCancellationRequested)
             {
-                long nowUs = sw.ElapsedTicks * 1_000_000 / Stopwatch.Frequency;
+                // Sleep on the OS timer until the spin window, then spin the rest
+                long diff = nextUs - NowUs(sw);
+                if (diff > _spinWindowUs)
+                {
+                    long target = nextUs - _spinWindowUs;
+                    timer.Wait(diff - _spinWindowUs);
+                    AdaptSpinWindow(NowUs(sw) - target);
+                }
 
-                long diff = nextUs - nowUs;
-                if (diff <= 0)
+                long spinStart = NowUs(sw);
+                long nowUs = spinStart;
+                while (nowUs < nextUs && !_cts.IsCancellationRequested)
                 {
-                    _tick();                 // send one 16-byte frame
-                    nextUs += _framePeriodUs;
-                    continue;
+                    Thread.SpinWait(20);
+                    nowUs = NowUs(sw);
                 }
+                _spinUs += nowUs - spinStart;
 
-                if (diff > 2000)            // >2 ms early? yield CPU
-                    Thread.Sleep(1);
-                else
-                    Thread.SpinWait(75);     // busy-wait ≈0.1 ms
+                if (_cts.IsCancellationRequested)
+                    break;
+
+                long lateUs = nowUs - nextUs;
+                Record(lateUs);
+
+                long missed = lateUs / _framePeriodUs;   // whole periods overdue
+
+                switch (_policy)
+                {
+                    case CatchUpPolicy.Skip:
+                        _tick(1 + (int)missed);
+                        _droppedFrames += missed;
+                        nextUs += (missed + 1) * _framePeriodUs;
+                        break;
+
+                    case CatchUpPolicy.Burst:
+                        long burst = Math.Min(missed, _maxBurst);
+                        for (long i = 0; i <= burst && !_cts.IsCancellationRequested; i++)
+                            _tick(1);
+                        _droppedFrames += missed - burst;
+                        nextUs += (missed + 1) * _framePeriodUs;
+                        break;
+
+                    case CatchUpPolicy.Stretch:
+                        _tick(1);
+                        nextUs = (missed > 0 ? nowUs : nextUs) + _framePeriodUs;
+                        break;
+                }
+
+                _elapsedUs = NowUs(sw);
             }
         }
 
-        public void Dispose() => _cts.Cancel();
+        // Keep the spin window just above the timer's observed oversleep,
+        // but never above the CPU budget.
+        private void AdaptSpinWindow(long oversleepUs)
+        {
+            long wanted = Math.Max(oversleepUs, 0) * 2 + 50;
+            _spinWindowUs = Math.Min((_spinWindowUs * 7 + wanted) / 8, _maxSpinUs);
+        }
+
+        private void Record(long lateUs)
+        {
+            int bucket = 0;
+            while (bucket < LatenessBucketsUs.Length && lateUs >= LatenessBucketsUs[bucket])
+                bucket++;
+
+            _lateness[bucket]++;
+            _frames++;
+            if (lateUs > _maxLatenessUs)
+                _maxLatenessUs = lateUs;
+        }
+
+        public long Frames => _frames;
+        public long DroppedFrames => _droppedFrames;
+        public long MaxLatenessUs => _maxLatenessUs;
+        public IReadOnlyList<long> LatenessHistogram => _lateness;
+
+        /// Fraction of one core spent spinning since the pump started.
+        public double SpinCpu => _elapsedUs > 0 ? (double)_spinUs / _elapsedUs : 0.0;
+
+        public override string ToString()
+        {
+            var sb = new StringBuilder();
+            sb.AppendLine($"FramePump: {_timerName}, {_policy}, {_frames} frames, {_droppedFrames} dropped, " +
+                          $"max late {_maxLatenessUs} µs, spin {SpinCpu:P1} CPU");
+
+            for (int i = 0; i < _lateness.Length; i++)
+            {
+                string range = i < LatenessBucketsUs.Length
+                    ? $"< {LatenessBucketsUs[i]} µs"
+                    : $">= {LatenessBucketsUs[i - 1]} µs";
+                sb.AppendLine($"  {range,-12} {_lateness[i]}");
+            }
+
+            return sb.ToString();
+        }
+
+        /// Stops the pump and waits for the tick in progress to return, so
+        /// nothing the tick uses is released underneath it. Called from
+        /// the tick itself it only cancels.
+        public void Dispose()
+        {
+            _cts.Cancel();
+            if (Thread.CurrentThread != _thread)
+                _thread.Join(1000);
+        }
     }
 }
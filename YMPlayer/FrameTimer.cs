@@ -0,0 +1,176 @@
+﻿using System;
+using System.Runtime.InteropServices;
+using System.Threading;
+
+namespace YMPlayer
+{
+    /// Blocks the calling thread for roughly the requested time without
+    /// spinning. Wake-up is allowed to be late; FramePump spins the rest.
+    public abstract class FrameTimer : IDisposable
+    {
+        public abstract string Name { get; }
+
+        public abstract void Wait(long microseconds);
+
+        public virtual void Dispose() { }
+
+        public static FrameTimer Create()
+        {
+            try
+            {
+                if (OperatingSystem.IsWindows())
+                    return new WaitableTimer();
+
+                if (OperatingSystem.IsLinux())
+                    return new TimerFd();
+            }
+            catch (Exception ex) when (ex is DllNotFoundException || ex is EntryPointNotFoundException || ex is InvalidOperationException)
+            {
+                // fall through to the portable timer
+            }
+
+            return new SleepTimer();
+        }
+    }
+
+    /// Portable fallback, resolution depends on the OS scheduler tick.
+    public sealed class SleepTimer : FrameTimer
+    {
+        public override string Name => "Thread.Sleep";
+
+        public override void Wait(long microseconds)
+        {
+            if (microseconds >= 1000)
+                Thread.Sleep((int)(microseconds / 1000));
+        }
+    }
+
+    /// Windows high resolution waitable timer (Windows 10 1803+), falls
+    /// back to a normal waitable timer on older versions.
+    public sealed class WaitableTimer : FrameTimer
+    {
+        private const uint CREATE_WAITABLE_TIMER_HIGH_RESOLUTION = 0x00000002;
+        private const uint TIMER_ALL_ACCESS = 0x001F0003;
+        private const uint INFINITE = 0xFFFFFFFF;
+
+        [DllImport("kernel32.dll", SetLastError = true, CharSet = CharSet.Unicode)]
+        private static extern IntPtr CreateWaitableTimerExW(IntPtr attributes, string name, uint flags, uint access);
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        private static extern bool SetWaitableTimer(IntPtr timer, ref long dueTime, int period, IntPtr completion, IntPtr arg, bool resume);
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        private static extern uint WaitForSingleObject(IntPtr handle, uint milliseconds);
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        private static extern bool CloseHandle(IntPtr handle);
+
+        private IntPtr _handle;
+        private readonly bool _highResolution;
+
+        public WaitableTimer()
+        {
+            _handle = CreateWaitableTimerExW(IntPtr.Zero, null, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+            _highResolution = _handle != IntPtr.Zero;
+
+            if (!_highResolution)
+                _handle = CreateWaitableTimerExW(IntPtr.Zero, null, 0, TIMER_ALL_ACCESS);
+
+            if (_handle == IntPtr.Zero)
+                throw new InvalidOperationException("CreateWaitableTimerEx failed: " + Marshal.GetLastWin32Error());
+        }
+
+        public override string Name => _highResolution ? "WaitableTimer (high resolution)" : "WaitableTimer";
+
+        public override void Wait(long microseconds)
+        {
+            if (microseconds <= 0)
+                return;
+
+            long dueTime = -microseconds * 10;     // relative, 100 ns units
+            if (SetWaitableTimer(_handle, ref dueTime, 0, IntPtr.Zero, IntPtr.Zero, false))
+                WaitForSingleObject(_handle, INFINITE);
+        }
+
+        public override void Dispose()
+        {
+            if (_handle != IntPtr.Zero)
+            {
+                CloseHandle(_handle);
+                _handle = IntPtr.Zero;
+            }
+        }
+    }
+
+    /// Linux timerfd on CLOCK_MONOTONIC, wakes with ~50 µs accuracy.
+    public sealed class TimerFd : FrameTimer
+    {
+        private const int CLOCK_MONOTONIC = 1;
+        private const int TFD_CLOEXEC = 0x80000;
+
+        [StructLayout(LayoutKind.Sequential)]
+        private struct TimeSpec
+        {
+            public nint Seconds;
+            public nint Nanoseconds;
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        private struct ITimerSpec
+        {
+            public TimeSpec Interval;
+            public TimeSpec Value;
+        }
+
+        [DllImport("libc", SetLastError = true)]
+        private static extern int timerfd_create(int clockId, int flags);
+
+        [DllImport("libc", SetLastError = true)]
+        private static extern int timerfd_settime(int fd, int flags, ref ITimerSpec newValue, IntPtr oldValue);
+
+        [DllImport("libc", SetLastError = true)]
+        private static extern nint read(int fd, byte[] buffer, nint count);
+
+        [DllImport("libc", SetLastError = true)]
+        private static extern int close(int fd);
+
+        private int _fd;
+        private readonly byte[] _expirations = new byte[8];
+
+        public TimerFd()
+        {
+            _fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+            if (_fd < 0)
+                throw new InvalidOperationException("timerfd_create failed: " + Marshal.GetLastWin32Error());
+        }
+
+        public override string Name => "timerfd";
+
+        public override void Wait(long microseconds)
+        {
+            if (microseconds <= 0)
+                return;
+
+            var spec = new ITimerSpec
+            {
+                Value = new TimeSpec
+                {
+                    Seconds = (nint)(microseconds / 1_000_000),
+                    Nanoseconds = (nint)(microseconds % 1_000_000 * 1000)
+                }
+            };
+
+            if (timerfd_settime(_fd, 0, ref spec, IntPtr.Zero) == 0)
+                read(_fd, _expirations, _expirations.Length);
+        }
+
+        public override void Dispose()
+        {
+            if (_fd >= 0)
+            {
+                close(_fd);
+                _fd = -1;
+            }
+        }
+    }
+}
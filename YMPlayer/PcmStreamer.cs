@@ -0,0 +1,179 @@
+﻿// benbaker76 (https://github.com/benbaker76)
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Text;
+
+namespace YMPlayer
+{
+    /// Host side of PCM streaming (commands 0x15-0x17 in YMPlayerSerial.h).
+    /// A WAV file becomes 4 bit chip levels at the device's sample rate,
+    /// packed one nibble per enabled voice per sample, and goes out in
+    /// data packets scheduled to keep the device's ring full.
+    public static class PcmStreamer
+    {
+        public const byte CmdPcmStart = 0x15;
+        public const byte CmdPcmData = 0x16;
+        public const byte CmdPcmStop = 0x17;
+
+        public const int MaxRate = 15625;           // PCM_MAX_RATE in the firmware
+        public const int AllVoices = 0x1FF;         // bit chip * 3 + voice
+        public const int MaxDataLength = 255;
+
+        // Sent this far ahead of the ring emptying, the device holds the
+        // port back (USB flow control) while its ring is full
+        public const int LeadUs = 20_000;
+
+        // 255 * 2^((level - 15) / 2), ymAmplitude in the firmware
+        private static readonly int[] Amplitude = { 0, 2, 3, 4, 6, 8, 11, 16, 23, 32, 45, 64, 90, 128, 180, 255 };
+
+        /// The rate the device plays for a requested one
+        public static int DeviceRate(int rate) => Math.Clamp(rate, 1, MaxRate);
+
+        public static int VoiceCount(int voiceMask)
+        {
+            int voices = 0;
+            for (int m = voiceMask & AllVoices; m != 0; m >>= 1)
+                voices += m & 1;
+            return voices;
+        }
+
+        /// Reads a RIFF WAVE file of 8 or 16 bit PCM as mono samples in
+        /// -1..1, channels averaged, resampled linearly to rate.
+        public static float[] LoadWav(string path, int rate)
+        {
+            using var br = new BinaryReader(File.OpenRead(path));
+
+            if (Encoding.ASCII.GetString(br.ReadBytes(4)) != "RIFF")
+                throw new InvalidDataException($"{path} is not a RIFF file");
+            br.ReadUInt32();
+            if (Encoding.ASCII.GetString(br.ReadBytes(4)) != "WAVE")
+                throw new InvalidDataException($"{path} is not a WAVE file");
+
+            int channels = 0, sourceRate = 0, bits = 0;
+            byte[] data = null;
+
+            while (br.BaseStream.Position + 8 <= br.BaseStream.Length && data == null)
+            {
+                string id = Encoding.ASCII.GetString(br.ReadBytes(4));
+                int size = br.ReadInt32();
+                long next = br.BaseStream.Position + size + (size & 1);
+
+                if (id == "fmt ")
+                {
+                    int format = br.ReadUInt16();
+                    channels = br.ReadUInt16();
+                    sourceRate = br.ReadInt32();
+                    br.ReadInt32();     // byte rate
+                    br.ReadUInt16();    // block align
+                    bits = br.ReadUInt16();
+
+                    if (format != 1 && format != 0xFFFE)
+                        throw new InvalidDataException($"{path}: format {format} is not PCM");
+                }
+                else if (id == "data")
+                    data = br.ReadBytes(size);
+
+                br.BaseStream.Position = Math.Min(next, br.BaseStream.Length);
+            }
+
+            if (data == null || channels == 0 || (bits != 8 && bits != 16))
+                throw new InvalidDataException($"{path}: needs 8 or 16 bit PCM");
+
+            int frameBytes = channels * bits / 8;
+            int count = data.Length / frameBytes;
+            var mono = new float[count];
+
+            for (int i = 0; i < count; i++)
+            {
+                float sum = 0;
+                for (int c = 0; c < channels; c++)
+                {
+                    int o = i * frameBytes + c * bits / 8;
+                    sum += bits == 8 ? (data[o] - 128) / 128f : BitConverter.ToInt16(data, o) / 32768f;
+                }
+                mono[i] = sum / channels;
+            }
+
+            var samples = new float[(int)((long)count * rate / sourceRate)];
+            for (int i = 0; i < samples.Length; i++)
+            {
+                double at = (double)i * sourceRate / rate;
+                int n = (int)at;
+                float t = (float)(at - n);
+                float a = mono[n];
+                float b = n + 1 < count ? mono[n + 1] : a;
+                samples[i] = a + (b - a) * t;
+            }
+            return samples;
+        }
+
+        /// Chip level for a sample: its amplitude on 0..255, rounded on
+        /// the chip's log scale at the geometric means, as ymLevel does.
+        public static byte Level(float sample)
+        {
+            double amplitude = (Math.Clamp(sample, -1f, 1f) + 1) * 127.5;
+            byte level = 0;
+            for (int i = 1; i < Amplitude.Length; i++)
+                if (amplitude > Math.Sqrt(Amplitude[i - 1] * Amplitude[i]))
+                    level = (byte)i;
+            return level;
+        }
+
+        /// Every sample on every voice in the mask, low nibble first.
+        public static byte[] Pack(float[] samples, int voiceMask)
+        {
+            int voices = VoiceCount(voiceMask);
+            var packed = new byte[((long)samples.Length * voices + 1) / 2];
+            long nibble = 0;
+
+            foreach (float sample in samples)
+            {
+                byte level = Level(sample);
+                for (int v = 0; v < voices; v++, nibble++)
+                    packed[nibble >> 1] |= (byte)((nibble & 1) != 0 ? level << 4 : level);
+            }
+            return packed;
+        }
+
+        /// Start packet: command, rate, voice mask.
+        public static byte[] StartPacket(int rate, int voiceMask)
+        {
+            return new[]
+            {
+                CmdPcmStart,
+                (byte)rate, (byte)(rate >> 8),
+                (byte)voiceMask, (byte)(voiceMask >> 8)
+            };
+        }
+
+        /// Data packets, each with the time in µs from the start it is
+        /// due: the ring's worth at once, the rest LeadUs before the
+        /// device would run dry.
+        public static IEnumerable<(long TimeUs, byte[] Packet)> Schedule(byte[] packed, int rate, int voiceMask)
+        {
+            double bytesPerUs = rate * VoiceCount(voiceMask) / 2e6;
+
+            for (int offset = 0; offset < packed.Length; offset += MaxDataLength)
+            {
+                int length = Math.Min(MaxDataLength, packed.Length - offset);
+                var packet = new byte[2 + length];
+                packet[0] = CmdPcmData;
+                packet[1] = (byte)length;
+                Array.Copy(packed, offset, packet, 2, length);
+
+                long due = (long)((offset - SongEncoder.DeviceBufferSize) / bytesPerUs) - LeadUs;
+                yield return (Math.Max(0, due), packet);
+            }
+        }
+
+        /// Time in µs the device needs to play packed; its first sample
+        /// falls due a period after the start.
+        public static long Duration(byte[] packed, int rate, int voiceMask)
+        {
+            long samples = (long)packed.Length * 2 / Math.Max(1, VoiceCount(voiceMask));
+            return (samples + 1) * 1_000_000 / rate;
+        }
+    }
+}
@@ -0,0 +1,279 @@
+﻿// benbaker76 (https://github.com/benbaker76)
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using System.Linq;
+using System.Security.Cryptography;
+using System.Text;
+using static YMPlayer.YMParser;
+
+namespace YMPlayer
+{
+    /// Precompiled song library. Build() decodes every module once and
+    /// stores its frames de-interleaved and masked, with the header fields
+    /// and digidrum samples, keyed by a SHA-256 of the module's files.
+    /// Open() memory maps the cache so a cached song costs no decompression.
+    ///
+    /// Layout (little endian):
+    ///   "YMPC" version indexOffset
+    ///   frame and sample blobs
+    ///   index: count, then per module the key, file stamps and chips
+    public sealed class PlaylistCache : IDisposable
+    {
+        private const uint Magic = 0x43504D59;  // "YMPC"
+        private const int Version = 1;
+
+        // Bits that carry neither register data nor YM5/YM6 effect data.
+        // R13 keeps 0xFF, which means "leave the envelope alone".
+        private static readonly byte[] RegisterMask =
+        {
+            0xFF, 0xFF,     // R0,R1   A period, R1 b4-7 effect 1
+            0xFF, 0xFF,     // R2,R3   B period, R3 b4-7 effect 2
+            0xFF, 0x0F,     // R4,R5   C period
+            0xFF,           // R6      noise, b5-7 effect 1 prescaler
+            0xFF,           // R7      mixer
+            0xFF,           // R8      A level, b5-7 effect 2 prescaler
+            0x1F, 0x1F,     // R9,R10  B,C level
+            0xFF, 0xFF,     // R11,R12 envelope period
+            0xFF,           // R13     envelope shape
+            0xFF, 0xFF      // R14,R15 effect timer counts
+        };
+
+        private sealed class ChipEntry
+        {
+            public string FileName, Type, Title, Artist, Comments;
+            public uint SongAttributes, YmFrequency;
+            public int FrameCount, FrameRate, FrameLoop;
+            public long FramesOffset;
+            public (long Offset, int Length, double NominalHz)[] DigiDrums;
+        }
+
+        private sealed class Entry
+        {
+            public string Stamp;
+            public ChipEntry[] Chips = new ChipEntry[3];
+        }
+
+        private readonly MemoryMappedFile _file;
+        private readonly Dictionary<string, Entry> _byStamp = new();
+        private readonly Dictionary<string, Entry> _byHash = new();
+
+        private PlaylistCache(string path)
+        {
+            long length = new FileInfo(path).Length;
+            _file = MemoryMappedFile.CreateFromFile(path, FileMode.Open, null, 0, MemoryMappedFileAccess.Read);
+
+            using var br = new BinaryReader(_file.CreateViewStream(0, length, MemoryMappedFileAccess.Read), Encoding.UTF8, false);
+            if (br.ReadUInt32() != Magic || br.ReadInt32() != Version)
+                throw new InvalidDataException("Not a playlist cache or wrong version");
+
+            br.BaseStream.Seek(br.ReadInt64(), SeekOrigin.Begin);
+
+            int count = br.ReadInt32();
+            for (int i = 0; i < count; i++)
+            {
+                string hash = br.ReadString();
+                var entry = new Entry { Stamp = br.ReadString() };
+
+                for (int chip = 0; chip < 3; chip++)
+                {
+                    if (!br.ReadBoolean())
+                        continue;
+
+                    var c = new ChipEntry
+                    {
+                        FileName = br.ReadString(),
+                        Type = br.ReadString(),
+                        Title = br.ReadString(),
+                        Artist = br.ReadString(),
+                        Comments = br.ReadString(),
+                        SongAttributes = br.ReadUInt32(),
+                        YmFrequency = br.ReadUInt32(),
+                        FrameCount = br.ReadInt32(),
+                        FrameRate = br.ReadInt32(),
+                        FrameLoop = br.ReadInt32(),
+                        FramesOffset = br.ReadInt64(),
+                        DigiDrums = new (long, int, double)[br.ReadInt32()]
+                    };
+                    for (int d = 0; d < c.DigiDrums.Length; d++)
+                        c.DigiDrums[d] = (br.ReadInt64(), br.ReadInt32(), br.ReadDouble());
+
+                    entry.Chips[chip] = c;
+                }
+
+                _byHash[hash] = entry;
+                _byStamp[entry.Stamp] = entry;
+            }
+        }
+
+        /// Opens the cache at path, or returns null when there is none.
+        public static PlaylistCache Open(string path)
+        {
+            if (!File.Exists(path))
+                return null;
+
+            try
+            {
+                return new PlaylistCache(path);
+            }
+            catch (Exception ex) when (ex is IOException || ex is InvalidDataException)
+            {
+                Console.WriteLine($"Ignoring playlist cache {path}: {ex.Message}");
+                return null;
+            }
+        }
+
+        public int Count => _byHash.Count;
+
+        /// Looks the module up by file size and time first, and by content
+        /// hash only when those changed. Returns null for unknown modules.
+        public YMModule TryLoad(string[] files)
+        {
+            if (!_byStamp.TryGetValue(Stamp(files), out var entry) &&
+                !_byHash.TryGetValue(Hash(files), out entry))
+                return null;
+
+            var parsers = new YMParser[3];
+            for (int chip = 0; chip < 3; chip++)
+            {
+                var c = entry.Chips[chip];
+                if (c == null)
+                    continue;
+
+                var drums = new List<DigiDrumSample>();
+                using (var view = _file.CreateViewAccessor(0, 0, MemoryMappedFileAccess.Read))
+                {
+                    foreach (var (offset, length, hz) in c.DigiDrums)
+                    {
+                        var data = new byte[length];
+                        view.ReadArray(offset, data, 0, length);
+                        drums.Add(new DigiDrumSample(data, hz));
+                    }
+                }
+
+                var frames = new YMFrameReader(
+                    _file.CreateViewAccessor(c.FramesOffset, (long)c.FrameCount * YMFrameReader.FrameSize, MemoryMappedFileAccess.Read),
+                    c.FrameCount, YMFrameReader.FrameSize, false);
+
+                parsers[chip] = new YMParser(c.FileName, c.Type, c.SongAttributes, c.YmFrequency,
+                                             c.FrameCount, c.FrameRate, c.FrameLoop,
+                                             c.Title, c.Artist, c.Comments, drums, frames);
+            }
+
+            return new YMModule(parsers);
+        }
+
+        /// Decodes every module and writes the cache to path. Modules that
+        /// fail to parse are reported and left out.
+        public static int Build(string path, IEnumerable<string[]> modules)
+        {
+            string temp = path + ".tmp";
+            int count = 0;
+
+            using (var bw = new BinaryWriter(File.Create(temp), Encoding.UTF8, false))
+            {
+                bw.Write(Magic);
+                bw.Write(Version);
+                bw.Write(0L);                   // index offset, patched below
+
+                var index = new MemoryStream();
+                var iw = new BinaryWriter(index, Encoding.UTF8, false);
+                var frame = new byte[YMFrameReader.FrameSize];
+
+                foreach (var files in modules)
+                {
+                    YMModule module;
+                    try
+                    {
+                        module = new YMModule(files);
+                    }
+                    catch (Exception ex)
+                    {
+                        Console.WriteLine($"Skipping {files[0]}: {ex.Message}");
+                        continue;
+                    }
+
+                    using (module)
+                    {
+                        iw.Write(Hash(files));
+                        iw.Write(Stamp(files));
+
+                        foreach (var parser in module.Parsers)
+                        {
+                            iw.Write(parser != null);
+                            if (parser == null)
+                                continue;
+
+                            var drumOffsets = new long[parser.DigiDrums.Count];
+                            for (int d = 0; d < drumOffsets.Length; d++)
+                            {
+                                drumOffsets[d] = bw.BaseStream.Position;
+                                bw.Write(parser.DigiDrums[d].Data);
+                            }
+
+                            long framesOffset = bw.BaseStream.Position;
+                            for (int f = 0; f < parser.FrameCount; f++)
+                            {
+                                parser.ReadFrame(f, frame);
+                                for (int r = 0; r < frame.Length; r++)
+                                    frame[r] &= RegisterMask[r];
+                                bw.Write(frame);
+                            }
+
+                            iw.Write(parser.FileName);
+                            iw.Write(parser.Type);
+                            iw.Write(parser.Title ?? "");
+                            iw.Write(parser.Artist ?? "");
+                            iw.Write(parser.Comments ?? "");
+                            iw.Write(parser.SongAttributes);
+                            iw.Write(parser.YmFrequency);
+                            iw.Write(parser.FrameCount);
+                            iw.Write(parser.FrameRate);
+                            iw.Write(parser.FrameLoop);
+                            iw.Write(framesOffset);
+                            iw.Write(drumOffsets.Length);
+                            for (int d = 0; d < drumOffsets.Length; d++)
+                            {
+                                iw.Write(drumOffsets[d]);
+                                iw.Write(parser.DigiDrums[d].Data.Length);
+                                iw.Write(parser.DigiDrums[d].NominalHz);
+                            }
+                        }
+                    }
+
+                    count++;
+                }
+
+                iw.Flush();
+                long indexOffset = bw.BaseStream.Position;
+                bw.Write(count);
+                index.WriteTo(bw.BaseStream);
+
+                bw.Seek(8, SeekOrigin.Begin);
+                bw.Write(indexOffset);
+            }
+
+            File.Move(temp, path, true);
+            return count;
+        }
+
+        private static string Stamp(string[] files) =>
+            string.Join("|", files.Select(f =>
+            {
+                var info = new FileInfo(f);
+                return $"{info.Name}:{info.Length}:{info.LastWriteTimeUtc.Ticks}";
+            }));
+
+        private static string Hash(string[] files)
+        {
+            using var hash = IncrementalHash.CreateHash(HashAlgorithmName.SHA256);
+            foreach (var file in files)
+                hash.AppendData(File.ReadAllBytes(file));
+            return Convert.ToHexString(hash.GetHashAndReset());
+        }
+
+        public void Dispose() => _file.Dispose();
+    }
+}
@@ -1,6 +1,7 @@
 ﻿// benbaker76 (https://github.com/benbaker76)
 
 using System;
+using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.Diagnostics;
 using System.IO;
@@ -21,17 +22,26 @@ namespace YMPlayer
 {
     class Program
     {
+        private const byte CmdProfile = 0x13;      // YMPlayerSerialClass::CMD_PROFILE
+        private const byte CmdBusBenchmark = 0x14; // YMPlayerSerialClass::CMD_BUS_BENCHMARK
+
         private static YMModule _ymModule = null;
         private static SerialPort _serialPort = null;
+        private static SerialFrameWriter _writer = null;
         private static FramePump _pump;
+        private static ConcurrentQueue<byte[]> _commands = new ConcurrentQueue<byte[]>();
+        private static PlaylistCache _cache = null;
 
         private static string[][] _modules;
         private static int _songIndex = 0;
+        private static int _nextSongIndex = 0;
+        private static Task<YMModule> _nextModule = null;
+        private static YMModule _retired = null;      // swapped out by the pump, finished by the main loop
+        private static int _pumpRate = 0;
         private static int _frameIndex = 0;
 
-        private static byte[] _emptyRegisters = new byte[16];
-
-        private const int PACKET_SIZE = 16;
+        private static byte[] _emptyRegisters = new byte[YMModule.FrameSize];
+        private static byte[] _frame = new byte[YMModule.FrameSize];
 
         public static void Main(string[] args)
         {
@@ -50,9 +60,110 @@ namespace YMPlayer
                 .Select(g => g.OrderBy(f => f).ToArray())
                 .ToArray();
 
+            string cachePath = Path.Combine(songsPath, "playlist.ympc");
+
+            if (args.Contains("--build-cache"))
+            {
+                Console.WriteLine($"Building {cachePath}");
+                int count = PlaylistCache.Build(cachePath, _modules);
+                Console.WriteLine($"Cached {count} of {_modules.Length} songs");
+                return;
+            }
+
+            int pcm = Array.IndexOf(args, "--pcm");
+            string pcmPath = pcm >= 0 && pcm + 1 < args.Length ? args[pcm + 1] : null;
+            int pcmRate = PcmStreamer.DeviceRate(IntArg(args, "--rate", 8000));
+            int pcmVoices = IntArg(args, "--voices", PcmStreamer.AllVoices) & PcmStreamer.AllVoices;
+
+            int capture = Array.IndexOf(args, "--capture");
+            if (capture >= 0 && capture + 1 < args.Length && pcmPath != null)
+            {
+                CapturePcm(args[capture + 1], pcmPath, pcmRate, pcmVoices);
+                Console.WriteLine($"Captured {pcmPath} at {pcmRate} Hz to {args[capture + 1]}");
+                return;
+            }
+
+            if (capture >= 0 && capture + 1 < args.Length)
+            {
+                int song = Array.IndexOf(args, "--song");
+                string name = song >= 0 && song + 1 < args.Length ? args[song + 1] : "";
+                var files = _modules.FirstOrDefault(m => Path.GetFileName(m[0]).Contains(name, StringComparison.OrdinalIgnoreCase));
+
+                if (files == null)
+                {
+                    Console.WriteLine($"No song matches '{name}'");
+                    return;
+                }
+
+                using var module = new YMModule(files);
+                Capture(args[capture + 1], module);
+                Console.WriteLine($"Captured {module.FrameCount} frames of {Path.GetFileName(files[0])} to {args[capture + 1]}");
+                return;
+            }
+
+            if (args.Contains("--benchmark-compression"))
+            {
+                YMCompressor.Benchmark(_modules);
+                if (args.Contains("--device"))
+                    BenchmarkDecoder();
+                return;
+            }
+
+            _cache = PlaylistCache.Open(cachePath);
+            if (_cache != null)
+                Console.WriteLine($"Playlist cache: {_cache.Count} songs");
+
             Console.WriteLine("YMPlayer, simple streamer for YM2149.");
-            Console.WriteLine("Press a key to Exit.");
+            Console.WriteLine("Press P for ISR timings (ISR_PROFILE firmware), B for a bus benchmark, any other key to Exit.");
+
+            OpenSerialPort();
+
+            SendFrame(_emptyRegisters);
+            _writer.Flush();
+
+            if (pcmPath != null)
+            {
+                StreamPcm(pcmPath, pcmRate, pcmVoices);
+                Shutdown();
+                return;
+            }
+
+            _songIndex = random.Next(_modules.Length);
+
+            _ymModule = LoadModule(_modules[_songIndex]);
+
+            _ymModule.UploadDigiDrums();
+            _ymModule.OutputInfo();
+
+            if (!args.Contains("--autonomous") || !StartAutonomous())
+            {
+                PrefetchNext();
+                StartPlayer();
+            }
 
+            for (;;)
+            {
+                if (!Console.KeyAvailable)
+                {
+                    FinishSwap();
+                    Thread.Sleep(10);
+                    continue;
+                }
+
+                var key = Console.ReadKey(true).Key;
+                if (key == ConsoleKey.P)
+                    PrintDeviceReport(new byte[] { CmdProfile, 0 }, 50);
+                else if (key == ConsoleKey.B)
+                    PrintDeviceReport(new byte[] { CmdBusBenchmark }, 500);
+                else
+                    break;
+            }
+
+            Shutdown();
+        }
+
+        static void OpenSerialPort()
+        {
             Console.WriteLine("Opening serial port");
             //_serialPort = new SerialPort("COM4", 115200)
             _serialPort = new SerialPort("COM7", 2_000_000)
@@ -62,45 +173,258 @@ namespace YMPlayer
             };
             _serialPort.Open();
 
-            SendRegisters(0, _emptyRegisters);
-            SendRegisters(1, _emptyRegisters);
-            SendRegisters(2, _emptyRegisters);
-
-            _songIndex = random.Next(_modules.Length);
-
-            _ymModule = new YMModule(_modules[_songIndex]);
+            _writer = new SerialFrameWriter(_serialPort);
+        }
 
-            _ymModule.UploadDigiDrums();
-            _ymModule.OutputInfo();
+        // Decodes the start of each song's first chip on the device
+        // (YMStreamDecoder, as much as fits the song buffer) and prints the
+        // cycles per frame it reports next to the register sum the host
+        // expects, so a decoder fault shows as a different sum.
+        static void BenchmarkDecoder()
+        {
+            OpenSerialPort();
 
-            StartPlayer();
+            foreach (var files in _modules)
+            {
+                using var module = new YMModule(files);
+                byte[] frames = module.Parsers.First(p => p != null).Bytes;
+                byte[] packet = YMCompressor.BenchmarkPacket(frames, out int frameCount, out ushort sum);
+
+                Console.Write($"{Path.GetFileName(files[0]),-28} expected frames={frameCount} sum={sum}  ");
+                if (!_writer.WriteNow(packet))
+                {
+                    Console.WriteLine("send timed out");
+                    continue;
+                }
+
+                // 16 registers a frame, well under a millisecond each
+                Thread.Sleep(100 + frameCount / 10);
+                Console.Write(_serialPort.ReadExisting());
+            }
 
-            Console.ReadKey();
+            Shutdown();
+        }
 
+        static void Shutdown()
+        {
             if (_pump != null)
             {
                 _pump.Dispose();
+                Console.WriteLine();
+                Console.Write(_pump);
                 _pump = null;
             }
 
             if (_serialPort != null)
             {
-                SendRegisters(0, _emptyRegisters);
-                SendRegisters(1, _emptyRegisters);
-                SendRegisters(2, _emptyRegisters);
+                SendFrame(_emptyRegisters);
+
+                // Dispose drains the queue before the port goes away
+                _writer.Dispose();
+                Console.WriteLine($"Serial: {_writer.Writes} writes, {_writer.DroppedPackets} dropped packets, {_writer.Timeouts} timeouts");
+                _writer = null;
 
                 _serialPort.Dispose();
                 _serialPort = null;
             }
+
+            _cache?.Dispose();
+        }
+
+        static int IntArg(string[] args, string name, int fallback)
+        {
+            int i = Array.IndexOf(args, name);
+            if (i < 0 || i + 1 >= args.Length)
+                return fallback;
+
+            string value = args[i + 1];
+            return value.StartsWith("0x", StringComparison.OrdinalIgnoreCase)
+                ? Convert.ToInt32(value.Substring(2), 16)
+                : int.Parse(value);
         }
 
         static void StartPlayer()
         {
-            _frameIndex = 0;
             _pump?.Dispose();
-            _pump = new FramePump(_ymModule.FrameRate, OnFrame);
+            if (_pump != null)
+                Console.Write(_pump);
+            _frameIndex = 0;
+            _pumpRate = _ymModule.FrameRate;
+            _pump = new FramePump(_pumpRate, OnFrame, CatchUpPolicy.Burst);
         }
 
+        // The pump thread only exchanges the modules when a tune ends (see
+        // OnFrame); the rest of the change runs here, off the frame schedule.
+        static void FinishSwap()
+        {
+            var next = _nextModule;
+            if (next != null && next.IsFaulted)
+            {
+                _songIndex = _nextSongIndex;
+                Console.WriteLine();
+                Console.WriteLine($"Failed to load {_modules[_songIndex][0]}: {next.Exception?.InnerException?.Message}");
+                PrefetchNext();
+            }
+
+            var previous = Volatile.Read(ref _retired);
+            if (previous == null)
+                return;
+
+            Console.WriteLine();
+            _ymModule.UploadDigiDrums();
+            _ymModule.OutputInfo();
+
+            // The running schedule carries on unless the rate changed
+            if (_ymModule.FrameRate != _pumpRate)
+                StartPlayer();
+
+            previous.Dispose();
+            PrefetchNext();
+            Volatile.Write(ref _retired, null);
+        }
+
+        // Sends a report command and prints what the device answers within
+        // waitMs: ISR cycle counts (IsrProfile, the counts restart after
+        // each request) or the bus benchmark (YM2149::benchmark, which
+        // stops a song playing on the device; streamed frames carry on).
+        static void PrintDeviceReport(byte[] command, int waitMs)
+        {
+            SendCommand(command);
+            Thread.Sleep(waitMs);
+            Console.Write(_serialPort.ReadExisting());
+        }
+
+        // The writer takes packets from one thread only: while the pump
+        // runs that is the pump thread, which sends the command with the
+        // next frame. Otherwise this thread is the producer.
+        static void SendCommand(byte[] command)
+        {
+            if (_pump != null)
+            {
+                _commands.Enqueue(command);
+                Thread.Sleep(1000 / _ymModule.FrameRate);
+            }
+            else
+                _writer.WriteNow(command);
+        }
+
+        // Uploads the current song and lets the device play it on its own.
+        // The next streamed frame (or the silence sent on exit) stops it.
+        static bool StartAutonomous()
+        {
+            byte[] song = SongEncoder.Encode(_ymModule, out int loopOffset);
+
+            if (song.Length > SongEncoder.DeviceBufferSize)
+            {
+                Console.WriteLine($"Song needs {song.Length} bytes, the device holds {SongEncoder.DeviceBufferSize}; streaming instead");
+                return false;
+            }
+
+            _writer.WriteNow(SongEncoder.UploadPacket(song, loopOffset));
+            _writer.WriteNow(new[] { SongEncoder.CmdSongPlay, (byte)_ymModule.FrameRate });
+
+            Console.WriteLine($"Playing on the device: {song.Length} bytes, loop at byte {loopOffset}");
+            return true;
+        }
+
+        // Writes the packets one pass of the song sends, each with its frame
+        // time in µs, for Tools/YMRender:  "YMCP" { u32 time, u16 length, bytes }
+        static void Capture(string path, YMModule module)
+        {
+            using var bw = new BinaryWriter(File.Create(path));
+            bw.Write(Encoding.ASCII.GetBytes("YMCP"));
+
+            void Packet(long timeUs, byte[] registers)
+            {
+                bw.Write((uint)timeUs);
+                bw.Write((ushort)(1 + YMModule.FrameSize));
+                bw.Write(SerialFrameWriter.AllChips);
+                bw.Write(registers, 0, YMModule.FrameSize);
+            }
+
+            long periodUs = 1_000_000 / module.FrameRate;
+
+            Packet(0, _emptyRegisters);
+            for (int f = 0; f < module.FrameCount; f++)
+            {
+                module.ReadFrame(f, _frame);
+                Packet(periodUs * (f + 1), _frame);
+            }
+            Packet(periodUs * (module.FrameCount + 1), _emptyRegisters);
+        }
+
+        // Streams a WAV file as 4 bit levels to the voices in voiceMask (see
+        // PcmStreamer). The device answers the start with the rate and
+        // voices it plays, and the stop with the samples it played and
+        // the ones it had no data for. Any key stops early.
+        static void StreamPcm(string path, int rate, int voiceMask)
+        {
+            byte[] packed = PcmStreamer.Pack(PcmStreamer.LoadWav(path, rate), voiceMask);
+            PrintDeviceReport(PcmStreamer.StartPacket(rate, voiceMask), 20);
+
+            var clock = Stopwatch.StartNew();
+            bool WaitUntil(long timeUs)
+            {
+                while (clock.Elapsed.TotalMicroseconds < timeUs)
+                {
+                    if (Console.KeyAvailable)
+                    {
+                        Console.ReadKey(true);
+                        return false;
+                    }
+                    Thread.Sleep(1);
+                }
+                return true;
+            }
+
+            bool playing = true;
+            foreach (var (timeUs, packet) in PcmStreamer.Schedule(packed, rate, voiceMask))
+            {
+                if (!(playing = WaitUntil(timeUs)))
+                    break;
+                _writer.WriteNow(packet);
+            }
+
+            if (playing)
+                WaitUntil(PcmStreamer.Duration(packed, rate, voiceMask));
+
+            PrintDeviceReport(new[] { PcmStreamer.CmdPcmStop }, 50);
+            Console.WriteLine($"{PcmStreamer.VoiceCount(voiceMask) * rate} level writes/s asked for");
+        }
+
+        // The packets StreamPcm sends, with their times, for Tools/YMRender
+        static void CapturePcm(string path, string wavPath, int rate, int voiceMask)
+        {
+            byte[] packed = PcmStreamer.Pack(PcmStreamer.LoadWav(wavPath, rate), voiceMask);
+
+            using var bw = new BinaryWriter(File.Create(path));
+            bw.Write(Encoding.ASCII.GetBytes("YMCP"));
+
+            void Packet(long timeUs, byte[] data)
+            {
+                bw.Write((uint)timeUs);
+                bw.Write((ushort)data.Length);
+                bw.Write(data);
+            }
+
+            Packet(0, PcmStreamer.StartPacket(rate, voiceMask));
+            foreach (var (timeUs, packet) in PcmStreamer.Schedule(packed, rate, voiceMask))
+                Packet(timeUs, packet);
+            Packet(PcmStreamer.Duration(packed, rate, voiceMask), new[] { PcmStreamer.CmdPcmStop });
+        }
+
+        // Loads and decodes the next song on the thread pool while the
+        // current one plays, so the pump thread never touches the disk.
+        static void PrefetchNext()
+        {
+            int index = (_songIndex + 1) % _modules.Length;
+            _nextSongIndex = index;
+            _nextModule = Task.Run(() => LoadModule(_modules[index]));
+        }
+
+        // Songs missing from the playlist cache are decoded from the file
+        static YMModule LoadModule(string[] files) => _cache?.TryLoad(files) ?? new YMModule(files);
+
         static void HandleEffect(Effect fx)
         {
             switch (fx.Type)
@@ -116,36 +440,46 @@ namespace YMPlayer
             }
         }
 
-        static void SendRegisters(int chipIndex, byte[] registers, int frameIndex = 0)
+        // All three chips go out in one packet, the firmware commits them together
+        static void SendFrame(byte[] registers)
         {
-            if (_serialPort == null || !_serialPort.IsOpen)
+            if (_writer == null)
                 return;
 
-            byte[] data = new byte[17];
-            data[0] = (byte)chipIndex;
-            Array.Copy(registers, frameIndex * PACKET_SIZE, data, 1, PACKET_SIZE);
-
-            // Write bytes in hex to console for debugging
-            //string hex = BitConverter.ToString(data).Replace("-", " ");
-            //Console.WriteLine($"Chip: {chipIndex} Frame: {frameIndex}: {hex}");
-
-            _serialPort.Write(data, 0, PACKET_SIZE + 1);
+            // Queued only, the writer thread sends it on the next Flush
+            _writer.Enqueue(SerialFrameWriter.AllChips, registers, 0, YMModule.FrameSize);
 
             /* if (_ymModule == null)
                 return;
 
-            var effects = _ymModule.GetEffects(chipIndex, frameIndex);
-
-            if (effects != null)
+            for (int chipIndex = 0; chipIndex < 3; chipIndex++)
             {
-                foreach (var fx in effects)
-                    HandleEffect(fx);
+                var effects = _ymModule.GetEffects(chipIndex, _frameIndex);
+
+                if (effects != null)
+                {
+                    foreach (var fx in effects)
+                        HandleEffect(fx);
+                }
             } */
         }
 
-        static void OnFrame()
+        static void OnFrame(int elapsed)
         {
-            _ymModule.SendFrame(_frameIndex, SendRegisters);
+            // A tune at another rate waits for the main loop to restart the pump
+            if (_ymModule.FrameRate != _pumpRate)
+                return;
+
+            // Frames dropped by the pump's Skip policy are skipped in the tune too
+            _frameIndex = Math.Min(_frameIndex + elapsed - 1, _ymModule.FrameCount - 1);
+
+            _ymModule.ReadFrame(_frameIndex, _frame);
+            SendFrame(_frame);
+
+            while (_commands.TryDequeue(out var command))
+                _writer.Enqueue(command[0], command, 1, command.Length - 1);
+
+            _writer.Flush();
 
             TimeSpan timeSpan = TimeSpan.FromSeconds((double)(_frameIndex + 1) / _ymModule.FrameRate);
             string cur = timeSpan.ToString(@"mm\:ss\.ff");
@@ -157,18 +491,20 @@ namespace YMPlayer
             {
                 _frameIndex = _ymModule.FrameLoop;
 
-                if (++_songIndex == _modules.Length)
-                    _songIndex = 0;
-
-                for (int i = 0; i < 3; i++)
-                    SendRegisters(i, _emptyRegisters);
+                // Keep looping the current song until the next one is decoded
+                // and the main loop has finished the previous swap
+                var next = _nextModule;
+                if (next == null || !next.IsCompletedSuccessfully || Volatile.Read(ref _retired) != null)
+                    return;
 
-                _ymModule = new YMModule(_modules[_songIndex]);
+                SendFrame(_emptyRegisters);
 
-                _ymModule.UploadDigiDrums();
-                _ymModule.OutputInfo();
-
-                StartPlayer();
+                _songIndex = _nextSongIndex;
+                var previous = _ymModule;
+                _ymModule = next.Result;
+                _nextModule = null;
+                _frameIndex = 0;
+                Volatile.Write(ref _retired, previous);
             }
         }
     }
@@ -0,0 +1,186 @@
+﻿using System;
+using System.IO.Ports;
+using System.Threading;
+
+namespace YMPlayer
+{
+    /// Queues register packets for the serial port and writes them from a
+    /// dedicated thread, so the frame pump never blocks on I/O.
+    ///
+    /// A packet is a header byte (chip index, or AllChips) followed by 16
+    /// registers per chip. Packets are copied into a preallocated byte
+    /// ring. Flush() publishes everything queued since the last call and
+    /// the writer sends all published packets, including any backlog of
+    /// earlier frames, in a single Write call. Only the writer thread
+    /// touches the port.
+    /// Single producer: Enqueue/Flush/Drain/WriteNow must be called from
+    /// one thread at a time.
+    public sealed class SerialFrameWriter : IDisposable
+    {
+        public const int FrameSize = 16;
+        public const byte AllChips = 3;
+        public const int MaxPacketLength = 1 + FrameSize * 3;
+
+        private readonly SerialPort _port;
+        private readonly int _capacity;
+        private readonly byte[] _ring;
+        private readonly byte[] _staging;
+        private readonly Thread _thread;
+        private readonly AutoResetEvent _signal = new AutoResetEvent(false);
+        private volatile bool _running = true;
+        private byte[] _bulk;       // handed from WriteNow to the writer
+
+        // Byte positions, monotonically increasing
+        private long _pending;      // producer only
+        private long _head;         // published, read by the writer
+        private long _tail;         // copied out, read by the producer
+        private long _written;      // sent to the port
+
+        private long _dropped, _writes, _timeouts;
+
+        public SerialFrameWriter(SerialPort port, int capacityFrames = 8)
+        {
+            _port = port;
+            _capacity = capacityFrames * MaxPacketLength;
+            _ring = new byte[_capacity];
+            _staging = new byte[_capacity];
+            _thread = new Thread(Run) { Name = "SerialFrameWriter", IsBackground = true };
+            _thread.Start();
+        }
+
+        /// Copies one packet into the ring. Drops it when the ring is full.
+        public bool Enqueue(byte header, byte[] registers, int offset, int length)
+        {
+            if (_pending - Volatile.Read(ref _tail) + 1 + length > _capacity)
+            {
+                _dropped++;
+                return false;
+            }
+
+            Put(header);
+            for (int i = 0; i < length; i++)
+                Put(registers[offset + i]);
+            return true;
+        }
+
+        private void Put(byte value) => _ring[_pending++ % _capacity] = value;
+
+        /// Publishes the queued packets to the writer thread.
+        public void Flush()
+        {
+            if (_pending == Volatile.Read(ref _head))
+                return;
+
+            Volatile.Write(ref _head, _pending);
+            _signal.Set();
+        }
+
+        /// Waits until everything published has been written.
+        public bool Drain(int timeoutMs)
+        {
+            Flush();
+            var deadline = Environment.TickCount64 + timeoutMs;
+            while (Volatile.Read(ref _written) != Volatile.Read(ref _head))
+            {
+                if (Environment.TickCount64 > deadline)
+                    return false;
+                Thread.Sleep(1);
+            }
+            return true;
+        }
+
+        /// Sends data that may be larger than the ring, such as a song
+        /// upload, after everything queued before it. The writer thread
+        /// does the write; returns false if it is not done within timeoutMs.
+        public bool WriteNow(byte[] data, int timeoutMs = 1000)
+        {
+            var deadline = Environment.TickCount64 + timeoutMs;
+
+            // A buffer from an earlier call that timed out goes first
+            if (!WaitForBulk(deadline))
+                return false;
+
+            Flush();
+            Volatile.Write(ref _bulk, data);
+            _signal.Set();
+            return WaitForBulk(deadline);
+        }
+
+        private bool WaitForBulk(long deadline)
+        {
+            while (Volatile.Read(ref _bulk) != null)
+            {
+                if (Environment.TickCount64 > deadline)
+                    return false;
+                Thread.Sleep(1);
+            }
+            return true;
+        }
+
+        private void Run()
+        {
+            while (_running)
+            {
+                _signal.WaitOne();
+
+                // Bulk data before head: WriteNow publishes the queued
+                // packets first, so they are all below this head
+                byte[] bulk = Volatile.Read(ref _bulk);
+                long head = Volatile.Read(ref _head);
+                long tail = _tail;
+
+                if (head != tail)
+                {
+                    // Coalesce all published packets into one contiguous write
+                    int count = (int)(head - tail);
+                    int first = (int)(tail % _capacity);
+                    int run = Math.Min(count, _capacity - first);
+                    Array.Copy(_ring, first, _staging, 0, run);
+                    if (run < count)
+                        Array.Copy(_ring, 0, _staging, run, count - run);
+
+                    Volatile.Write(ref _tail, head);
+                    Write(_staging, count);
+                    Volatile.Write(ref _written, head);
+                }
+
+                if (bulk != null)
+                {
+                    Write(bulk, bulk.Length);
+                    Volatile.Write(ref _bulk, null);
+                }
+            }
+        }
+
+        private void Write(byte[] data, int count)
+        {
+            try
+            {
+                if (_port.IsOpen)
+                    _port.Write(data, 0, count);
+                _writes++;
+            }
+            catch (TimeoutException)
+            {
+                _timeouts++;
+            }
+            catch (InvalidOperationException)
+            {
+                // port closed underneath us
+            }
+        }
+
+        public long DroppedPackets => _dropped;
+        public long Writes => _writes;
+        public long Timeouts => _timeouts;
+
+        public void Dispose()
+        {
+            Drain(500);
+            _running = false;
+            _signal.Set();
+            _thread.Join(500);
+            _signal.Dispose();
+        }
+    }
+}
@@ -0,0 +1,111 @@
+﻿// benbaker76 (https://github.com/benbaker76)
+
+using System;
+using System.IO;
+
+namespace YMPlayer
+{
+    /// Encodes a module for autonomous playback on the device, see the
+    /// token format in YMPlayerSerial.h. Each frame stores only the
+    /// registers that changed since the previous one, unchanged frames
+    /// collapse into repeat runs, and the loop frame is stored in full so
+    /// the device can restart there.
+    public static class SongEncoder
+    {
+        public const int DeviceBufferSize = 1024;    // SONG_BUFFER_SIZE in the firmware
+
+        public const byte CmdSongUpload = 0x10;
+        public const byte CmdSongPlay = 0x11;
+        public const byte CmdSongStop = 0x12;
+
+        private const int MaxRepeat = 0x80;
+        private const int EnvShapeRegister = 13;
+        private const byte EnvShapeKeep = 0xFF;     // YM files: do not retrigger
+
+        public static byte[] Encode(YMModule module, out int loopOffset)
+        {
+            var output = new MemoryStream();
+            var frame = new byte[YMModule.FrameSize];
+            var previous = new byte[YMModule.FrameSize];
+            var masks = new ushort[3];
+            int repeat = 0;
+
+            loopOffset = 0;
+
+            for (int f = 0; f < module.FrameCount; f++)
+            {
+                module.ReadFrame(f, frame);
+                bool key = f == 0 || f == module.FrameLoop;
+
+                int chips = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    masks[c] = 0;
+                    for (int r = 0; r < YMFrameReader.FrameSize; r++)
+                    {
+                        int i = c * YMFrameReader.FrameSize + r;
+                        bool changed = r == EnvShapeRegister
+                            ? frame[i] != EnvShapeKeep
+                            : key || frame[i] != previous[i];
+                        if (changed)
+                            masks[c] |= (ushort)(1 << r);
+                    }
+                    if (masks[c] != 0)
+                        chips |= 1 << c;
+                }
+
+                if (chips == 0 && !key)
+                {
+                    if (++repeat == MaxRepeat)
+                        FlushRepeat(output, ref repeat);
+                    continue;
+                }
+
+                FlushRepeat(output, ref repeat);
+
+                if (f == module.FrameLoop)
+                    loopOffset = (int)output.Position;
+
+                output.WriteByte((byte)chips);
+                for (int c = 0; c < 3; c++)
+                {
+                    if (masks[c] == 0)
+                        continue;
+
+                    output.WriteByte((byte)masks[c]);
+                    output.WriteByte((byte)(masks[c] >> 8));
+                    for (int r = 0; r < YMFrameReader.FrameSize; r++)
+                        if ((masks[c] & (1 << r)) != 0)
+                            output.WriteByte(frame[c * YMFrameReader.FrameSize + r]);
+                }
+
+                Array.Copy(frame, previous, frame.Length);
+            }
+
+            FlushRepeat(output, ref repeat);
+            return output.ToArray();
+        }
+
+        private static void FlushRepeat(Stream output, ref int repeat)
+        {
+            if (repeat == 0)
+                return;
+
+            output.WriteByte((byte)(0x80 | (repeat - 1)));
+            repeat = 0;
+        }
+
+        /// Upload packet: command, length, loop offset, song bytes.
+        public static byte[] UploadPacket(byte[] song, int loopOffset)
+        {
+            var packet = new byte[5 + song.Length];
+            packet[0] = CmdSongUpload;
+            packet[1] = (byte)song.Length;
+            packet[2] = (byte)(song.Length >> 8);
+            packet[3] = (byte)loopOffset;
+            packet[4] = (byte)(loopOffset >> 8);
+            Array.Copy(song, 0, packet, 5, song.Length);
+            return packet;
+        }
+    }
+}
@@ -0,0 +1,282 @@
+﻿// benbaker76 (https://github.com/benbaker76)
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+
+namespace YMPlayer
+{
+    /// Host side of the per-register stream codec decoded on the device by
+    /// YMStreamDecoder (see YMStreamDecoder.h for the token format). Each
+    /// register of a chip is compressed on its own with runs, literals and
+    /// replays of literal bytes already in the stream, so the decoder needs
+    /// no history of its own.
+    public static class YMCompressor
+    {
+        public const int Streams = 16;              // YMZ_STREAMS
+        public const byte CmdStreamBenchmark = 0x18; // YMPlayerSerialClass::CMD_STREAM_BENCHMARK
+
+        private const int MaxRun = 64;
+        private const int MaxLiteral = 64;
+        private const int MinReplay = 4;            // YMZ_MIN_REPLAY
+        private const int MaxReplay = 127;          // the decoder's count is 7 bits
+
+        /// Compresses frames of one chip (16 bytes each) into a block of
+        /// 16 stream offsets followed by the streams.
+        public static byte[] Compress(byte[] frames)
+        {
+            int frameCount = frames.Length / Streams;
+            var streams = new List<byte[]>();
+
+            for (int s = 0; s < Streams; s++)
+            {
+                var values = new byte[frameCount];
+                for (int f = 0; f < frameCount; f++)
+                    values[f] = frames[f * Streams + s];
+                streams.Add(CompressStream(values));
+            }
+
+            var block = new MemoryStream();
+            int offset = Streams * 2;
+            foreach (var stream in streams)
+            {
+                block.WriteByte((byte)offset);
+                block.WriteByte((byte)(offset >> 8));
+                offset += stream.Length;
+            }
+            foreach (var stream in streams)
+                block.Write(stream);
+
+            if (block.Length > ushort.MaxValue)
+                throw new InvalidDataException("Compressed block exceeds 64 KB");
+
+            return block.ToArray();
+        }
+
+        private static byte[] CompressStream(byte[] v)
+        {
+            var output = new MemoryStream();
+            var literals = new List<byte>();
+
+            // Literal payloads written so far: where they start in the
+            // stream and how long they are. Replays may only read these.
+            var payloads = new List<(int Start, int Length)>();
+            byte[] written = null;
+
+            void FlushLiterals()
+            {
+                for (int i = 0; i < literals.Count; i += MaxLiteral)
+                {
+                    int n = Math.Min(MaxLiteral, literals.Count - i);
+                    output.WriteByte((byte)(0x40 | (n - 1)));
+                    payloads.Add(((int)output.Position, n));
+                    for (int j = 0; j < n; j++)
+                        output.WriteByte(literals[i + j]);
+                }
+                literals.Clear();
+                written = null;
+            }
+
+            int pos = 0;
+            while (pos < v.Length)
+            {
+                byte last = pos > 0 ? v[pos - 1] : (byte)0;
+
+                int run = 0;
+                while (pos + run < v.Length && run < MaxRun && v[pos + run] == last)
+                    run++;
+
+                int replay = 0, source = 0;
+                if (run < MaxRun)
+                {
+                    written ??= output.ToArray();
+
+                    foreach (var (start, length) in payloads)
+                    {
+                        for (int j = start; j < start + length; j++)
+                        {
+                            int limit = Math.Min(MaxReplay, start + length - j);
+                            int n = 0;
+                            while (n < limit && pos + n < v.Length && v[pos + n] == written[j + n])
+                                n++;
+                            if (n > replay)
+                            {
+                                replay = n;
+                                source = j;
+                            }
+                        }
+                    }
+                }
+
+                if (run >= 2 && run >= replay)
+                {
+                    FlushLiterals();
+                    output.WriteByte((byte)(run - 1));
+                    pos += run;
+                }
+                else if (replay >= MinReplay)
+                {
+                    FlushLiterals();
+                    int back = (int)output.Position + 3 - source;
+                    output.WriteByte((byte)(0x80 | (replay - MinReplay)));
+                    output.WriteByte((byte)back);
+                    output.WriteByte((byte)(back >> 8));
+                    pos += replay;
+                }
+                else
+                {
+                    literals.Add(v[pos++]);
+                }
+            }
+
+            FlushLiterals();
+            return output.ToArray();
+        }
+
+        /// Reference decoder, step for step the same as the firmware.
+        /// Returns the frames and the most bytes read for any one frame.
+        public static byte[] Decompress(byte[] block, int frameCount, out int maxBytesPerFrame)
+        {
+            const int Literal = 0x80;
+
+            var pos = new int[Streams];
+            var ret = new int[Streams];
+            var count = new int[Streams];
+            var last = new byte[Streams];
+
+            byte Read(int p) => p < block.Length ? block[p] : (byte)0;
+
+            for (int s = 0; s < Streams; s++)
+                pos[s] = Read(s * 2) | (Read(s * 2 + 1) << 8);
+
+            var frames = new byte[frameCount * Streams];
+            maxBytesPerFrame = 0;
+
+            for (int f = 0; f < frameCount; f++)
+            {
+                int bytesRead = 0;
+
+                for (int s = 0; s < Streams; s++)
+                {
+                    if ((count[s] & ~Literal) == 0)
+                    {
+                        if (ret[s] != 0)
+                        {
+                            pos[s] = ret[s];
+                            ret[s] = 0;
+                        }
+
+                        byte token = Read(pos[s]++);
+                        bytesRead++;
+
+                        if ((token & 0x80) != 0)
+                        {
+                            int back = Read(pos[s]) | (Read(pos[s] + 1) << 8);
+                            pos[s] += 2;
+                            bytesRead += 2;
+                            ret[s] = pos[s];
+                            pos[s] -= back;
+                            count[s] = Literal | ((token & 0x7F) + MinReplay);
+                        }
+                        else
+                        {
+                            count[s] = ((token & 0x40) != 0 ? Literal : 0) | ((token & 0x3F) + 1);
+                        }
+                    }
+
+                    if ((count[s] & Literal) != 0)
+                    {
+                        last[s] = Read(pos[s]++);
+                        bytesRead++;
+                    }
+
+                    count[s]--;
+                    frames[f * Streams + s] = last[s];
+                }
+
+                maxBytesPerFrame = Math.Max(maxBytesPerFrame, bytesRead);
+            }
+
+            return frames;
+        }
+
+        /// Builds the CMD_STREAM_BENCHMARK packet for the device: the
+        /// longest start of the frames whose block fits the song buffer,
+        /// as  CMD, u16 length, u16 frames, block.  expectedSum is the
+        /// 16 bit sum of every decoded register the device reports back.
+        public static byte[] BenchmarkPacket(byte[] frames, out int frameCount, out ushort expectedSum)
+        {
+            int low = 0, high = frames.Length / Streams;
+
+            while (low < high)
+            {
+                int mid = (low + high + 1) / 2;
+                byte[] candidate = Compress(frames.AsSpan(0, mid * Streams).ToArray());
+                if (candidate.Length <= SongEncoder.DeviceBufferSize)
+                    low = mid;
+                else
+                    high = mid - 1;
+            }
+
+            frameCount = low;
+            byte[] block = Compress(frames.AsSpan(0, low * Streams).ToArray());
+
+            expectedSum = 0;
+            for (int i = 0; i < low * Streams; i++)
+                expectedSum += frames[i];
+
+            var packet = new byte[5 + block.Length];
+            packet[0] = CmdStreamBenchmark;
+            packet[1] = (byte)block.Length;
+            packet[2] = (byte)(block.Length >> 8);
+            packet[3] = (byte)frameCount;
+            packet[4] = (byte)(frameCount >> 8);
+            Array.Copy(block, 0, packet, 5, block.Length);
+            return packet;
+        }
+
+        /// Prints size and decode cost for each module: raw frames, the
+        /// delta/RLE song format and this codec. Decode cost is counted in
+        /// bytes read per frame, which is what the AVR decoder's time
+        /// scales with.
+        public static void Benchmark(IEnumerable<string[]> modules)
+        {
+            Console.WriteLine($"{"Song",-28} {"Frames",7} {"Raw",8} {"Delta",8} {"Stream",8} {"Ratio",6} {"Max B/f",8}");
+
+            long totalRaw = 0, totalDelta = 0, totalStream = 0;
+
+            foreach (var files in modules)
+            {
+                using var module = new YMModule(files);
+
+                int raw = 0, compressed = 0, maxBytes = 0;
+                foreach (var parser in module.Parsers.Where(p => p != null))
+                {
+                    byte[] frames = parser.Bytes;
+                    byte[] block = Compress(frames);
+
+                    byte[] check = Decompress(block, parser.FrameCount, out int maxPerFrame);
+                    if (!check.AsSpan().SequenceEqual(frames))
+                        throw new InvalidDataException($"{parser.FileName}: round trip mismatch");
+
+                    raw += frames.Length;
+                    compressed += block.Length;
+                    maxBytes = Math.Max(maxBytes, maxPerFrame);
+                }
+
+                int delta = SongEncoder.Encode(module, out _).Length;
+
+                string name = Path.GetFileName(files[0]);
+                Console.WriteLine($"{name,-28} {module.FrameCount,7} {raw,8} {delta,8} {compressed,8} {(double)raw / compressed,6:F1} {maxBytes,8}");
+
+                totalRaw += raw;
+                totalDelta += delta;
+                totalStream += compressed;
+            }
+
+            if (totalStream > 0)
+                Console.WriteLine($"{"Total",-28} {"",7} {totalRaw,8} {totalDelta,8} {totalStream,8} {(double)totalRaw / totalStream,6:F1}");
+        }
+    }
+}
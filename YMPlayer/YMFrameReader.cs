@@ -0,0 +1,83 @@
+﻿// benbaker76 (https://github.com/benbaker76)
+
+using System;
+using System.IO.MemoryMappedFiles;
+
+namespace YMPlayer
+{
+    /// Reads register frames straight from the file data, either a byte
+    /// array or a memory mapped view, without building a de-interleaved copy.
+    ///
+    /// Interleaved YM data is register-major: all frames of r0, then all
+    /// frames of r1, ... so register r of frame f is at r * frameCount + f.
+    /// Otherwise frames are stored one after another.
+    public sealed class YMFrameReader : IDisposable
+    {
+        public const int FrameSize = 16;
+
+        private readonly byte[] _buffer;
+        private readonly MemoryMappedViewAccessor _view;
+        private readonly long _offset;
+        private readonly int _frameCount;
+        private readonly int _registers;
+        private readonly bool _interleaved;
+
+        public YMFrameReader(byte[] buffer, long offset, int frameCount, int registers, bool interleaved)
+        {
+            _buffer = buffer;
+            _offset = offset;
+            _frameCount = frameCount;
+            _registers = registers;
+            _interleaved = interleaved;
+        }
+
+        public YMFrameReader(MemoryMappedViewAccessor view, int frameCount, int registers, bool interleaved)
+        {
+            _view = view;
+            _frameCount = frameCount;
+            _registers = registers;
+            _interleaved = interleaved;
+        }
+
+        public int FrameCount => _frameCount;
+
+        /// Copies frame into registers (16 bytes), registers the format
+        /// does not store are cleared.
+        public void ReadFrame(int frame, Span<byte> registers)
+        {
+            if ((uint)frame >= (uint)_frameCount)
+                throw new ArgumentOutOfRangeException(nameof(frame));
+
+            if (_interleaved)
+            {
+                for (int r = 0; r < _registers; r++)
+                    registers[r] = Get(_offset + (long)r * _frameCount + frame);
+            }
+            else if (_buffer != null)
+            {
+                _buffer.AsSpan((int)(_offset + (long)frame * _registers), _registers).CopyTo(registers);
+            }
+            else
+            {
+                long pos = _offset + (long)frame * _registers;
+                for (int r = 0; r < _registers; r++)
+                    registers[r] = _view.ReadByte(pos + r);
+            }
+
+            registers.Slice(_registers, FrameSize - _registers).Clear();
+        }
+
+        /// Builds the whole tune as consecutive 16 byte frames.
+        public byte[] ToArray()
+        {
+            var bytes = new byte[_frameCount * FrameSize];
+            for (int f = 0; f < _frameCount; f++)
+                ReadFrame(f, bytes.AsSpan(f * FrameSize, FrameSize));
+            return bytes;
+        }
+
+        private byte Get(long pos) => _buffer != null ? _buffer[pos] : _view.ReadByte(pos);
+
+        public void Dispose() => _view?.Dispose();
+    }
+}
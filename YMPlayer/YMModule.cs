@@ -10,14 +10,22 @@ using static YMPlayer.YMParser;
 
 namespace YMPlayer
 {
-    public class YMModule
+    /// One to three YM files (.1.ym/.2.ym/.3.ym) played as a single frame
+    /// stream. The module is as long as its longest file and loops as a
+    /// whole at the first file's loop frame; a chip whose file is shorter
+    /// is silent for the rest of the pass.
+    public class YMModule : IDisposable
     {
+        public const int FrameSize = 3 * YMFrameReader.FrameSize;
+
         public YMParser[] Parsers { get; } = new YMParser[3];
 
-        public int FrameCount => Parsers[0]?.FrameCount ?? 0;
-        public int FrameRate => Parsers[0]?.FrameRate ?? 50;
-        public int FrameLoop => Parsers[0]?.FrameLoop ?? 0;
-        public TimeSpan TotalTime => Parsers[0]?.TotalTime ?? TimeSpan.Zero;
+        private YMParser Primary => Parsers.FirstOrDefault(p => p != null);
+
+        public int FrameCount => Parsers.Max(p => p?.FrameCount ?? 0);
+        public int FrameRate => Primary?.FrameRate ?? 50;
+        public int FrameLoop => Math.Min(Primary?.FrameLoop ?? 0, Math.Max(FrameCount - 1, 0));
+        public TimeSpan TotalTime => TimeSpan.FromSeconds((double)FrameCount / FrameRate);
 
         public YMModule(IEnumerable<string> files)
         {
@@ -25,16 +33,26 @@ namespace YMPlayer
             {
                 var match = Regex.Match(file, @"\.(\d)\.ym$", RegexOptions.IgnoreCase);
                 int index = match.Success ? int.Parse(match.Groups[1].Value) - 1 : 0;
-                Parsers[index] = new YMParser(file);
+                Parsers[index] = new YMParser(file, streaming: true);
             }
         }
 
-        public void SendFrame(int frameIndex, Action<int, byte[], int> sendRegisters)
+        public YMModule(YMParser[] parsers)
+        {
+            Array.Copy(parsers, Parsers, Parsers.Length);
+        }
+
+        /// Fills frame with the 16 registers of chips 0, 1 and 2.
+        public void ReadFrame(int frameIndex, Span<byte> frame)
         {
             for (int chip = 0; chip < 3; chip++)
             {
+                var registers = frame.Slice(chip * YMFrameReader.FrameSize, YMFrameReader.FrameSize);
+
                 if (Parsers[chip] != null && frameIndex < Parsers[chip].FrameCount)
-                    sendRegisters(chip, Parsers[chip].Bytes, frameIndex);
+                    Parsers[chip].ReadFrame(frameIndex, registers);
+                else
+                    registers.Clear();
             }
         }
 
@@ -76,5 +94,11 @@ namespace YMPlayer
                 Console.WriteLine();
             }
         }
+
+        public void Dispose()
+        {
+            foreach (var parser in Parsers)
+                parser?.Dispose();
+        }
     }
 }
@@ -4,6 +4,7 @@ using LHADecompressor;
 using System;
 using System.Collections.Generic;
 using System.IO;
+using System.IO.MemoryMappedFiles;
 using System.Linq;
 using System.Text;
 using System.Threading;
@@ -12,7 +13,7 @@ using static YMPlayer.YMParser;
 
 namespace YMPlayer
 {
-    public class YMParser
+    public class YMParser : IDisposable
     {
         public enum EffectType
         {
@@ -34,34 +35,58 @@ namespace YMPlayer
         private int _frameCount, _frameLoop, _frameRate;
         private TimeSpan _totalTime;
         private byte[] _bytes;
+        private MemoryMappedFile _mappedFile;
+        private YMFrameReader _frames;
 
         private readonly List<DigiDrumSample> _digiDrumList = new();
 
-        public YMParser(string fileName)
+        /// With streaming set an uncompressed file is memory mapped and its
+        /// frames are read in place, so opening costs only the header.
+        /// LHA packed files are unpacked once into a single buffer that
+        /// the frames are read from. Neither mode de-interleaves up front.
+        public YMParser(string fileName, bool streaming = false)
         {
             _fileName = fileName;
-            byte[] data = File.ReadAllBytes(fileName);
-            bool isRaw = Encoding.ASCII.GetString(data, 0, 4).StartsWith("YM");
-            if (!isRaw)
+
+            byte[] data = null;
+            Stream stream;
+            long length;
+
+            if (IsRawYM(fileName))
+            {
+                length = new FileInfo(fileName).Length;
+
+                if (streaming)
+                {
+                    _mappedFile = MemoryMappedFile.CreateFromFile(fileName, FileMode.Open, null, 0, MemoryMappedFileAccess.Read);
+                    stream = _mappedFile.CreateViewStream(0, length, MemoryMappedFileAccess.Read);
+                }
+                else
+                {
+                    data = File.ReadAllBytes(fileName);
+                    stream = new MemoryStream(data, false);
+                }
+            }
+            else
             {
                 var lha = new LhaFile(fileName, Encoding.UTF8);
                 data = lha.GetEntryBytes(lha.GetEntry(0));
+                length = data.Length;
+                stream = new MemoryStream(data, false);
             }
 
-            using var br = new BinaryReader(new MemoryStream(data), Encoding.ASCII, false);
+            using var br = new BinaryReader(stream, Encoding.ASCII, false);
             _type = new string(br.ReadChars(4));
 
             if (_type == "YM3b")
             {
-                int primitiveFrames = (data.Length - 8) / 14;
+                // 14 registers, always interleaved, loop frame after the data
+                int primitiveFrames = (int)((length - 8) / 14);
                 _frameCount = primitiveFrames;
-                byte[] raw = br.ReadBytes(_frameCount * 14);
+                br.BaseStream.Seek(4 + (long)_frameCount * 14, SeekOrigin.Begin);
                 _frameLoop = (int)br.ReadUInt32();
 
-                _bytes = new byte[_frameCount * 16];
-                for (int reg = 0; reg < 14; reg++)
-                    for (int f = 0; f < _frameCount; f++)
-                        _bytes[f * 16 + reg] = raw[reg * _frameCount + f];
+                _frames = CreateFrameReader(data, 4, 14, true);
 
                 _digidrumsSamples = 0;
                 _ymFrequency = 0;
@@ -121,7 +146,7 @@ namespace YMPlayer
                                 raw[n] = (byte)(raw[n] - 128);
                         }
 
-                        // Nominal playback rate =   MFP 2 456 kHz / (TP × TC)
+                        // Nominal playback rate =   MFP 2 456 kHz / (TP × TC)
                         // We only store the divider pair so the uploader can decide.
                         ushort timerCount = Swap(br.ReadUInt16());
                         byte timerPre = br.ReadByte();
@@ -137,8 +162,10 @@ namespace YMPlayer
 
                 _isYM6 = _type == "YM6!";
 
-                raw = br.ReadBytes(_frameCount * 16);
-                _bytes = ((_songAttributes & 1) != 0) ? DeInterleave(raw, _frameCount) : raw;
+                if (br.BaseStream.Position + (long)_frameCount * 16 > length)
+                    throw new EndOfStreamException("Frame data truncated inside file.");
+
+                _frames = CreateFrameReader(data, br.BaseStream.Position, 16, (_songAttributes & 1) != 0);
             }
 
             if (_frameRate == 0) _frameRate = 50;
@@ -147,15 +174,48 @@ namespace YMPlayer
             _totalTime = TimeSpan.FromSeconds((double)_frameCount / _frameRate);
         }
 
-        private byte[] DeInterleave(byte[] raw, int frames)
+        /// Wraps frames that were already decoded, see PlaylistCache.
+        internal YMParser(string fileName, string type, uint songAttributes, uint ymFrequency,
+                          int frameCount, int frameRate, int frameLoop,
+                          string title, string artist, string comments,
+                          IEnumerable<DigiDrumSample> digiDrums, YMFrameReader frames)
+        {
+            _fileName = fileName;
+            _type = type;
+            _isYM6 = type == "YM6!";
+            _songAttributes = songAttributes;
+            _digidrumsSamples = (ushort)digiDrums.Count();
+            _ymFrequency = ymFrequency;
+            _frameCount = frameCount;
+            _frameRate = frameRate;
+            _frameLoop = frameLoop;
+            _title = title;
+            _artist = artist;
+            _comments = comments;
+            _digiDrumList.AddRange(digiDrums);
+            _frames = frames;
+            _totalTime = TimeSpan.FromSeconds((double)_frameCount / _frameRate);
+        }
+
+        private static bool IsRawYM(string fileName)
+        {
+            using var fs = File.OpenRead(fileName);
+            var head = new byte[2];
+            return fs.Read(head, 0, 2) == 2 && head[0] == (byte)'Y' && head[1] == (byte)'M';
+        }
+
+        private YMFrameReader CreateFrameReader(byte[] data, long offset, int registers, bool interleaved)
         {
-            var outp = new byte[raw.Length];
-            for (int r = 0; r < 16; r++)
-                for (int f = 0; f < frames; f++)
-                    outp[f * 16 + r] = raw[r * frames + f];
-            return outp;
+            if (data != null)
+                return new YMFrameReader(data, offset, _frameCount, registers, interleaved);
+
+            var view = _mappedFile.CreateViewAccessor(offset, (long)_frameCount * registers, MemoryMappedFileAccess.Read);
+            return new YMFrameReader(view, _frameCount, registers, interleaved);
         }
 
+        /// Copies the 16 registers of frame into registers.
+        public void ReadFrame(int frame, Span<byte> registers) => _frames.ReadFrame(frame, registers);
+
         private static int PreDivToFactor(int tp) => tp switch
         {
             1 => 4,
@@ -190,20 +250,21 @@ namespace YMPlayer
 
         private Effect? DecodeEffect(int frame, int flagR, int timerR, int countR)
         {
-            int idx = frame * 16;
-            byte flag = _bytes[idx + flagR];
+            Span<byte> regs = stackalloc byte[16];
+            _frames.ReadFrame(frame, regs);
+            byte flag = regs[flagR];
 
             int vBits = (flag >> 4) & 0x03;       // 00 = no effect
             if (vBits == 0) return null;
             int voice = vBits - 1;                // 0‑2
 
-            int tp = (_bytes[idx + timerR] >> 5) & 0x07;
-            int tc = _bytes[idx + countR];
+            int tp = (regs[timerR] >> 5) & 0x07;
+            int tc = regs[countR];
 
             return flagR switch
             {
                 1 => new SIDEffect(EffectType.SIDVoice, frame, voice, tp, tc, (flag & 0x40) != 0),
-                3 => new DigiDrumEffect(EffectType.DigiDrum, frame, voice, tp, tc, _bytes[idx + 8 + voice] & 0x1F),
+                3 => new DigiDrumEffect(EffectType.DigiDrum, frame, voice, tp, tc, regs[8 + voice] & 0x1F),
                 _ => null
             };
         }
@@ -307,6 +368,14 @@ namespace YMPlayer
         public string Artist { get { return _artist; } }
         public string Comments { get { return _comments; } }
 
-        public byte[] Bytes { get { return _bytes; } }
+        /// The whole tune as consecutive 16 byte frames, built on first use.
+        /// Prefer ReadFrame, this allocates the full unpacked size.
+        public byte[] Bytes { get { return _bytes ??= _frames.ToArray(); } }
+
+        public void Dispose()
+        {
+            _frames?.Dispose();
+            _mappedFile?.Dispose();
+        }
     }
 }
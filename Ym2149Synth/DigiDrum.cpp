@@ -48,7 +48,6 @@ const uint8_t sample39[] PROGMEM = { 0x8A, 0x42, 0x00, 0x00, 0x0E, 0x00, 0x00, 0
 */
 const uint8_t* const sampleAddress[] PROGMEM = { sample00, sample01, sample02, sample03, sample04, sample05, sample06, sample07, sample08, sample09, sample10, sample11, sample12, sample13, sample14, sample15, /* sample16, sample17, sample18, sample19, sample20, sample21, sample22, sample23, sample24, sample25, sample26, sample27, sample28, sample29, sample30, sample31, sample32, sample33, sample34, sample35, sample36, sample37, sample38, sample39 */ };
 
-const int sampleLen[] PROGMEM = { 631, 631, 490, 490, 699, 505, 727, 480, 2108, 4231, 378, 1527, 258, 258, 451, 1795, 271, 633, 1379, 147, 139, 85, 150, 507, 230, 120, 271, 293, 391, 391, 391, 407, 407, 407, 317, 407, 311, 459, 329, 656 };
+static_assert(sizeof(sampleAddress) / sizeof(sampleAddress[0]) == DIGIDRUM_COUNT, "DIGIDRUM_COUNT");
 
-const uint8_t* const * const _dSampleAddr PROGMEM = sampleAddress;
-const uint16_t * const _dSampleLen PROGMEM = sampleLen;
+const uint16_t sampleLen[] PROGMEM = { 631, 631, 490, 490, 699, 505, 727, 480, 2108, 4231, 378, 1527, 258, 258, 451, 1795, 271, 633, 1379, 147, 139, 85, 150, 507, 230, 120, 271, 293, 391, 391, 391, 407, 407, 407, 317, 407, 311, 459, 329, 656 };
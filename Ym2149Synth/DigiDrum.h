@@ -44,7 +44,7 @@ extern const uint8_t sample37[] PROGMEM;
 extern const uint8_t sample38[] PROGMEM;
 extern const uint8_t sample39[] PROGMEM;
 extern const uint8_t* const sampleAddress[] PROGMEM;
-extern const int sampleLen[] PROGMEM;
+extern const uint16_t sampleLen[] PROGMEM;
 
-extern const uint8_t* const * const _dSampleAddr PROGMEM;
-extern const uint16_t * const _dSampleLen PROGMEM;
\ No newline at end of file
+// Samples in sampleAddress, sampleLen lists all 40
+constexpr uint8_t DIGIDRUM_COUNT = 16;
@@ -0,0 +1,59 @@
+// benbaker76 (https://github.com/benbaker76)
+
+#include "IsrProfile.h"
+#include <util/atomic.h>
+
+void IsrProfileClass::begin(const char * n,
+                            volatile uint16_t * c,
+                            volatile uint8_t * f, uint8_t m,
+                            uint8_t ticks)
+{
+    name = n;
+    counter = c;
+    flags = f;
+    flagMask = m;
+    cyclesPerTick = ticks;
+    reset();
+}
+
+void IsrProfileClass::reset()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        minCycles = 0xFFFFFFFF;
+        maxCycles = 0;
+        totalCycles = 0;
+        count = 0;
+        overruns = 0;
+    }
+}
+
+// "effects n=31250 min=182 avg=204 max=655 over=0"
+void IsrProfileClass::report()
+{
+    uint32_t n, lo, hi, total;
+    uint16_t over;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        n = count;
+        lo = minCycles;
+        hi = maxCycles;
+        total = totalCycles;
+        over = overruns;
+    }
+
+    Serial.print(name);
+    Serial.print(" n=");
+    Serial.print(n);
+    Serial.print(" min=");
+    Serial.print(n ? lo : 0);
+    Serial.print(" avg=");
+    Serial.print(n ? total / n : 0);
+    Serial.print(" max=");
+    Serial.print(hi);
+    Serial.print(" over=");
+    Serial.println((unsigned long)over);
+
+    reset();
+}
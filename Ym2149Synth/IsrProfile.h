@@ -0,0 +1,102 @@
+// benbaker76 (https://github.com/benbaker76)
+
+#ifndef IsrProfile_h
+#define IsrProfile_h
+
+#include "Arduino.h"
+
+// ----------------------------------------------------------
+// ISR profiling:  0 = compiled out,  1 = enabled. Off by
+// default, it costs both timer ISRs; build with
+// -DISR_PROFILE=1 for the CMD_PROFILE reports.
+// ----------------------------------------------------------
+#ifndef ISR_PROFILE
+#define ISR_PROFILE 0
+#endif
+
+// ----------------------------------------------------------
+// Cycle statistics for one timer interrupt.
+//
+// exit() reads the interrupt's own timer. In CTC mode the
+// counter restarted at the compare match that raised the
+// interrupt, so it holds the time since the interrupt fired,
+// entry latency and nested interrupts included. If the
+// compare flag is set again by then, the next period has
+// already started and the ISR counts as an overrun.
+//
+// The cycle total is 32 bit and wraps after a few minutes of
+// a busy ISR; report() resets it.
+//
+// The song ISR is nested (ISR_NOBLOCK), so the effects ISR
+// can cut into it. The counter is read with interrupts off:
+// 16 bit timer reads go through the TEMP register all timers
+// share. The scope bit is a mask known only at run time, a
+// read-modify-write of PORTB that the effects ISR, which
+// drives the bus pins on PORTB, must not cut into either.
+//
+// With a scope bit set, the PORTB pin is high for the length
+// of the ISR (the chip LEDs are on PORTB).
+// ----------------------------------------------------------
+class IsrProfileClass {
+  public:
+    void begin(const char * name,
+               volatile uint16_t * counter,
+               volatile uint8_t * flags, uint8_t flagMask,
+               uint8_t cyclesPerTick);
+
+    void setScopeBit(uint8_t portBBit) { scopeBit = portBBit; }
+
+    inline void enter()
+    {
+#if ISR_PROFILE
+        if (scopeBit)
+        {
+            uint8_t sreg = SREG;
+            cli();
+            PORTB |= scopeBit;
+            SREG = sreg;
+        }
+#endif
+    }
+
+    inline void exit()
+    {
+#if ISR_PROFILE
+        uint8_t sreg = SREG;
+        cli();
+        uint16_t ticks = *counter;
+        bool overrun = *flags & flagMask;
+        if (scopeBit) PORTB &= ~scopeBit;
+        SREG = sreg;
+
+        uint32_t cycles = (uint32_t)ticks * cyclesPerTick;
+
+        if (overrun) overruns++;
+        if (cycles < minCycles) minCycles = cycles;
+        if (cycles > maxCycles) maxCycles = cycles;
+        totalCycles += cycles;
+        count++;
+#endif
+    }
+
+    void reset();
+    void report();      // one line on Serial, then reset
+
+  private:
+    const char * name;
+    volatile uint16_t * counter;
+    volatile uint8_t * flags;
+    uint8_t flagMask;
+    uint8_t cyclesPerTick;
+    uint8_t scopeBit = 0;
+
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint32_t totalCycles;
+    uint32_t count;
+    uint16_t overruns;
+};
+
+typedef IsrProfileClass IsrProfile;
+
+#endif
@@ -23,6 +23,9 @@ public:
     virtual void onTransportStart() {}
     virtual void onTransportStop() {}
     virtual void onTransportContinue() {}
+    virtual void onSysExStart(MidiCallbackClass *midi) {}
+    virtual void onSysExData(MidiCallbackClass *midi) {}
+    virtual void onSysExEnd(MidiCallbackClass *midi) {}
 
     virtual void sendRealTime(uint8_t message) {}
     virtual void sendNoteOn(uint8_t channel, uint8_t note, uint8_t value) {}
@@ -32,6 +35,9 @@ public:
     virtual void sendProgramChange(uint8_t channel, uint8_t patchNumber) {}
     virtual void sendAfterTouch(uint8_t channel, uint8_t patchNumber) {}
     virtual void sendPitchBend(uint8_t channel, uint16_t value) {}
+    // Raw SysEx bytes, the caller frames the message with 0xF0 / 0xF7
+    // and may send it in several fragments.
+    virtual void sendSysEx(const uint8_t *data, uint16_t length) {}
 
     virtual void sendTransportClock() { sendRealTime(0xF8); }
     virtual void sendTransportStart() { sendRealTime(0xFA); }
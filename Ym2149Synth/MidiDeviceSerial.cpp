@@ -10,8 +10,6 @@ void MidiDeviceSerialClass::update()
     if(serial->available()) {
         uint8_t data = serial->read();
 
-        //@TODO checkForProgrammerSysex(data);
-
         if(data & 0x80) {
             switch (data) {
                 case 0xF8:
@@ -34,7 +32,22 @@ void MidiDeviceSerialClass::update()
                 case 0xFE:
                 case 0xFF:
                     break;
+                case 0xF0:
+                    // SysEx Start, cancels running status
+                    command = 0;
+                    sysex = true;
+                    callback->onSysExStart(this);
+                    break;
+                case 0xF7:
+                    // SysEx End
+                    if(sysex) {
+                        sysex = false;
+                        callback->onSysExEnd(this);
+                    }
+                    break;
                 default:
+                    // Any other status byte aborts an unterminated SysEx
+                    sysex = false;
                     command = data;
                     data1 = -1;
                     data2 = -1;
@@ -42,6 +55,9 @@ void MidiDeviceSerialClass::update()
                     callback->onCommand(this);
             }
 
+        } else if(sysex) {
+            data1 = data;
+            callback->onSysExData(this);
         } else if(command && data1 == -1) {
             data1 = data;
             callback->onData1(this);
@@ -173,6 +189,10 @@ void MidiDeviceSerialClass::sendPitchBend(uint8_t c, uint8_t value1, uint8_t val
     serial->write(d, 3);
 }
 
+void MidiDeviceSerialClass::sendSysEx(const uint8_t * data, uint16_t length)
+{
+    serial->write(data, length);
+}
 
 void MidiDeviceSerialClass::onNoteOn(MidiCallbackClass * midi)
 {
@@ -20,6 +20,7 @@ class MidiDeviceSerialClass : public MidiCallback {
     void sendProgramChange(uint8_t channel, uint8_t patchNumber);
     void sendAfterTouch(uint8_t channel, uint8_t value);
     void sendPitchBend(uint8_t channel, uint8_t value1, uint8_t value2);
+    void sendSysEx(const uint8_t * data, uint16_t length);
     void sendTransportClock() { sendRealTime(0xF8); };
     void sendTransportStart() { sendRealTime(0xFA); };
     void sendTransportContinue() { sendRealTime(0xFB); };
@@ -50,6 +51,7 @@ class MidiDeviceSerialClass : public MidiCallback {
     unsigned long baud;
     int channel;
     int command;
+    bool sysex = false;
     int data1;
     int data2;
     int chipIndex;
@@ -44,22 +44,25 @@ void SynthControllerClass::begin()
         Ym.mute(chip);
     }
 
-    Patch[0].init(); // EEPROM init
-
-    for (int chip = 0; chip < 3; chip++) {
-        Patch[chip].init(); // EEPROM init for each chip
-
-        for (int voice = 0; voice < 3; voice++) {
-            int index = chip * 3 + voice;
-            Synth[index].begin(&Ym, chip, voice);
-            Patch[chip].begin(); // or Patch[index] if you go per-voice patching
-        }
+    // Three synths, voices A-C of chip 0, each with its own patch bank
+    // and EEPROM record
+    for (int synth = 0; synth < 3; synth++) {
+        Synth[synth].begin(&Ym, 0, synth);
+
+        Patch[synth].setChipIndex(synth);
+        Patch[synth].init();
+        Patch[synth].begin();
     }
+
+    SysEx.begin(Patch, 3);
 }
 
 void SynthControllerClass::update()
 {
-
+    // Background EEPROM flush of saved presets
+    Patch[0].update();
+    Patch[1].update();
+    Patch[2].update();
 }
 
 void SynthControllerClass::updateSoftSynths()
@@ -181,7 +184,7 @@ void SynthControllerClass::onControlChange(MidiCallbackClass * midi)
                 break;
             case 122:
                 uint8_t buffer[Patch[synth].patchSize];
-                Patch[0].getPatch(&buffer[0], midi->getData2());
+                Patch[synth].getPatch(&buffer[0], midi->getData2());
                 for(uint8_t i=0;i!=Patch[synth].patchSize;i++) {
                     midi->sendControlChange(midi->getChannel(), i+1, buffer[i]);
                 }
@@ -227,6 +230,21 @@ void SynthControllerClass::onPitchBend(MidiCallbackClass * midi)
     }
 }
 
+void SynthControllerClass::onSysExStart(MidiCallbackClass * midi)
+{
+    SysEx.onStart();
+}
+
+void SynthControllerClass::onSysExData(MidiCallbackClass * midi)
+{
+    SysEx.onData(midi->getData1());
+}
+
+void SynthControllerClass::onSysExEnd(MidiCallbackClass * midi)
+{
+    SysEx.onEnd(midi);
+}
+
 void SynthControllerClass::benchmark()
 {
     // Notes:
@@ -257,6 +275,15 @@ void SynthControllerClass::benchmark()
 
     unsigned long t2 = micros();
 
+    Serial.println(t2-t1);
+
+    // keyTrig note-on, the same patch every time: 100 loads
+    t1 = micros();
+    for(int i=0;i<100;i++) {
+        Patch[0].load(&Synth[0], 8);
+    }
+    t2 = micros();
+
     Serial.println(t2-t1);
     delay(500);
 }
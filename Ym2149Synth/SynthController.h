@@ -26,6 +26,7 @@
 #include "MidiCallback.h"
 #include "YM2149.h"
 #include "SynthPatchStorage.h"
+#include "SynthSysEx.h"
 #include "SynthVoice.h"
 
 class SynthControllerClass : public MidiCallback {
@@ -41,11 +42,15 @@ class SynthControllerClass : public MidiCallback {
     void onProgramChange(MidiCallbackClass * midi);
     void onAfterTouch(MidiCallbackClass * midi);
     void onPitchBend(MidiCallbackClass * midi);
+    void onSysExStart(MidiCallbackClass * midi);
+    void onSysExData(MidiCallbackClass * midi);
+    void onSysExEnd(MidiCallbackClass * midi);
 
     void benchmark();
 
     SynthVoice Synth[3];
     SynthPatchStorage Patch[3];
+    SynthSysEx SysEx;
     YM2149 Ym;
     uint8_t channels[3];
 
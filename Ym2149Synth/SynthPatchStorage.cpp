@@ -21,9 +21,12 @@
  */
 
 #include "SynthPatchStorage.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
 
-//@TODO document this class
-uint8_t SynthPatchStorageClass::bank[MAX_PATCHES][11] = {
+// Factory presets, copied into a bank the first time a patch is used
+// and nothing valid is stored in EEPROM for it
+const uint8_t SynthPatchStorageClass::defaultBank[MAX_PATCHES][patchSize] PROGMEM = {
     { 1, 0, 0, 0, 0, 64, 0, 0, 0, 0, 64 },
     { 0, 0, 1, 0, 0, 64, 0, 0, 0, 0, 0 },
     { 0, 0, 2, 0, 0, 64, 0, 0, 0, 0, 0 },
@@ -42,6 +45,9 @@ uint8_t SynthPatchStorageClass::bank[MAX_PATCHES][11] = {
     { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
 };
 
+uint8_t SynthPatchStorageClass::flushTurn = 0;
+uint8_t SynthPatchStorageClass::instances = 1;
+
 void SynthPatchStorageClass::begin()
 {
 
@@ -49,91 +55,251 @@ void SynthPatchStorageClass::begin()
 
 void SynthPatchStorageClass::init()
 {
-    int chipOffset = chipIndex * numberPatches * patchSize;
+    // Patches are read as they are used, see readPatch()
+    dirty = 0;
+    held = 0;
+    headerDirty = false;
+    lastPatch = -1;
+    if (chipIndex >= instances) instances = chipIndex + 1;
 
-    if (EEPROM.read(chipOffset + numberPatches * patchSize) != 0xF1) return;
+    // The header is checked, and legacy presets migrated, before anything
+    // can be saved: update() writes the new header over legacy patch 0
+    checkStore();
 
-    for (uint8_t p = 0; p < numberPatches; p++) {
-        for (uint8_t v = 0; v < patchSize; v++) {
-            bank[p][v] = EEPROM.read(chipOffset + (p * patchSize) + v);
+    SynthVoice::compile(&patchTemp[0], tempParams);
+}
+
+void SynthPatchStorageClass::checkStore()
+{
+    int base = storeOffset();
+
+    if (EEPROM.read(base) == storeMagic && EEPROM.read(base + 1) == storeVersion) {
+        storeState = STORE_VALID;
+        return;
+    }
+
+    storeState = STORE_EMPTY;
+
+    // Presets saved before the versioned layout live unchecked at 0..175.
+    // They overlap the new records, so the whole bank is migrated at once.
+    if (chipIndex == 0 && EEPROM.read(numberPatches * patchSize) == legacyMagic) {
+        for (uint8_t p = 0; p < numberPatches; p++) {
+            for (uint8_t v = 0; v < patchSize; v++) {
+                pending[p][v] = EEPROM.read((p * patchSize) + v);
+            }
+            markDirty(p);
+        }
+    }
+}
+
+// A patch as it stands: its slot while that is waiting to be written,
+// else the EEPROM record if its CRC matches, else the default
+void SynthPatchStorageClass::readPatch(uint8_t patch, uint8_t * buffer)
+{
+    if ((dirty & ~held) & (1U << patch)) {
+        memcpy(buffer, &pending[patch][0], patchSize);
+        return;
+    }
+
+    if (storeState == STORE_VALID) {
+        uint8_t record[recordSize];
+        int address = storeOffset() + headerSize + patch * recordSize;
+
+        for (uint8_t v = 0; v < recordSize; v++) {
+            record[v] = EEPROM.read(address + v);
+        }
+        if (crc(record) == record[patchSize]) {
+            memcpy(buffer, record, patchSize);
+            return;
         }
     }
+
+    memcpy_P(buffer, &defaultBank[patch][0], patchSize);
+}
+
+// The slot of a patch, holding the patch, to be changed and marked dirty
+uint8_t * SynthPatchStorageClass::stage(uint8_t patch)
+{
+    if (!(dirty & (1U << patch))) {
+        readPatch(patch, &pending[patch][0]);
+    }
+    return &pending[patch][0];
 }
 
 void SynthPatchStorageClass::load(SynthVoice * synth, int patch)
 {
     if(patch >= numberPatches) return;
-    uint8_t * pp;
-    selectedPatch = patch;
+
     if(patch < 0) {
-        //load from temp
-        pp = &patchTemp[0];
-    } else {
-        pp = &SynthPatchStorageClass::bank[patch][0];
+        //load from temp, compiled whenever it is edited
+        synth->apply(tempParams);
+        return;
     }
 
-    synth->setPwmFreq(*(pp++));
-    synth->setSoftDetune(*(pp++));
-    synth->setSynthType(*(pp++));
-    synth->setVolumeEnvShape(*(pp++));
-    synth->setGlide(*(pp++));
-    synth->setVibratoFreq(*(pp++));
-    synth->setVibratoAmount(*(pp++));
-    synth->setNoiseDelay(*(pp++));
-    synth->setPitchEnvAmount(*(pp++));
-    synth->setPitchEnvShape(*(pp++));
-    synth->setTranspose(*(pp));
+    selectedPatch = patch;
+
+    if(patch != lastPatch) {
+        uint8_t data[patchSize];
+        readPatch(patch, data);
+        SynthVoice::compile(data, lastParams);
+        lastPatch = patch;
+    }
+    synth->apply(lastParams);
 }
 
 void SynthPatchStorageClass::getPatch(uint8_t * buffer, int patch)
 {
     if(patch >= numberPatches) return;
-    uint8_t * pp;
 
     if(patch < 0) {
         //load from temp
-        pp = &patchTemp[0];
+        memcpy(buffer, &patchTemp[0], patchSize);
     } else {
-        pp = &SynthPatchStorageClass::bank[patch][0];
+        readPatch(patch, buffer);
     }
+}
 
-    for(uint8_t v=0;v<patchSize;v++) {
-        *(buffer++) = *(pp++);
-    }
+// The slots stay out of the flush until save(); loads meanwhile read
+// the EEPROM
+uint8_t * SynthPatchStorageClass::editBank()
+{
+    held = 0xFFFF;
+    return &pending[0][0];
+}
+
+// Drops the slots editBank() handed out, the patches are as stored
+void SynthPatchStorageClass::revert()
+{
+    if (lastPatch >= 0 && (held & (1U << lastPatch))) lastPatch = -1;
+    dirty &= ~held;
+    held = 0;
 }
 
 void SynthPatchStorageClass::save()
 {
-    int chipOffset = chipIndex * numberPatches * patchSize;
+    for (uint8_t p = 0; p < numberPatches; p++) {
+        if (!(held & (1U << p))) stage(p);
+    }
+    held = 0;
+    for (uint8_t p = 0; p < numberPatches; p++) {
+        markDirty(p);
+    }
+}
 
-    if (EEPROM.read(chipOffset + numberPatches * patchSize) != 0xF1)
-        EEPROM.write(chipOffset + numberPatches * patchSize, 0xF1);
+void SynthPatchStorageClass::markDirty(uint8_t patch)
+{
+    if (patch >= numberPatches) return;
 
-    for (uint8_t p = 0; p < numberPatches; p++) {
-        for (uint8_t v = 0; v < patchSize; v++) {
-            EEPROM.write(chipOffset + (p * patchSize) + v, bank[p][v]);
+    dirty |= 1U << patch;
+    headerDirty = true;
+    if (patch == lastPatch) lastPatch = -1;
+
+    // Restart a record that is half written so its CRC matches the new data
+    if (patch == flushPatch) {
+        flushByte = 0;
+        flushCrc = 0;
+    }
+}
+
+void SynthPatchStorageClass::passTurn()
+{
+    flushTurn = (flushTurn + 1) % instances;
+}
+
+/*
+ * Background flush, call from loop() for every instance. Writes at most
+ * one EEPROM byte per call and never waits on the EEPROM, bytes that
+ * already hold the right value are skipped without a write. The
+ * instances take turns, one record each.
+ */
+void SynthPatchStorageClass::update()
+{
+    if (flushTurn != chipIndex) return;
+
+    if (!isSaving()) {
+        passTurn();
+        return;
+    }
+    if (!eeprom_is_ready()) return;
+
+    int base = storeOffset();
+
+    if (headerDirty) {
+        if (EEPROM.read(base) != storeMagic) {
+            EEPROM.write(base, storeMagic);
+            return;
         }
+        if (EEPROM.read(base + 1) != storeVersion) {
+            EEPROM.write(base + 1, storeVersion);
+            return;
+        }
+        headerDirty = false;
+        storeState = STORE_VALID;   // readPatch() checks the records from now on
+        if (!isSaving()) return;
+    }
+
+    uint16_t ready = dirty & ~held;
+    while (!(ready & (1U << flushPatch))) {
+        flushPatch = (flushPatch + 1) % numberPatches;
+        flushByte = 0;
+        flushCrc = 0;
+    }
+
+    int address = base + headerSize + flushPatch * recordSize;
+
+    while (flushByte < recordSize) {
+        uint8_t value;
+        if (flushByte < patchSize) {
+            value = pending[flushPatch][flushByte];
+            flushCrc = _crc8_ccitt_update(flushCrc, value);
+        } else {
+            value = flushCrc;
+        }
+
+        uint8_t a = flushByte++;
+        if (EEPROM.read(address + a) != value) {
+            EEPROM.write(address + a, value);
+            if (flushByte < recordSize) return;
+        }
+    }
+
+    dirty &= ~(1U << flushPatch);
+    flushByte = 0;
+    flushCrc = 0;
+    passTurn();
+}
+
+uint8_t SynthPatchStorageClass::crc(const uint8_t * data)
+{
+    uint8_t c = 0;
+    for (uint8_t v = 0; v < patchSize; v++) {
+        c = _crc8_ccitt_update(c, data[v]);
     }
+    return c;
 }
 
 void SynthPatchStorageClass::flush()
 {
-    memcpy(&bank[selectedPatch][0], &patchTemp[0], patchSize);
+    memcpy(stage(selectedPatch), &patchTemp[0], patchSize);
+    markDirty(selectedPatch);
 }
 
 void SynthPatchStorageClass::recall()
 {
-    memcpy(&patchTemp[0], &bank[selectedPatch][0], patchSize);
+    readPatch(selectedPatch, &patchTemp[0]);
+    SynthVoice::compile(&patchTemp[0], tempParams);
 }
 
 void SynthPatchStorageClass::setValue(uint8_t address,uint8_t value)
 {
     if(address >= patchSize) return;
     patchTemp[address] = value;
+    SynthVoice::compile(&patchTemp[0], tempParams);
 }
 
 void SynthPatchStorageClass::writeValue(uint8_t address,uint8_t value)
 {
     if(address >= patchSize) return;
-    SynthPatchStorageClass::bank[selectedPatch][address] = value;
+    stage(selectedPatch)[address] = value;
+    markDirty(selectedPatch);
 }
@@ -29,18 +29,29 @@
 #include "EEPROM.h"
 #include "SynthVoice.h"
 
+/*
+ * One synth's 16 patches: an edit buffer (patchTemp) and its EEPROM
+ * store. Patches are read from EEPROM as they are loaded. A patch
+ * that is written goes into its slot in pending, which stands in for
+ * the record until update() has written it back in the background,
+ * one byte per call. The instances take turns at the EEPROM a record
+ * at a time, so none waits for another.
+ */
 class SynthPatchStorageClass {
   public:
     void begin();
     void init();
     void load(SynthVoice * synth, int preset);
     void getPatch(uint8_t * buffer, int patch);
+    uint8_t * editBank();           // all 16 slots to overwrite, then save() or revert()
+    void revert();
     void save();
     void save(uint8_t patch) {
         selectedPatch = patch;
         flush();
-        save();
     };
+    void update();
+    bool isSaving() { return (dirty & ~held) != 0 || headerDirty; }
     void flush();
     void recall();
     void setValue(uint8_t address,uint8_t value);
@@ -49,13 +60,57 @@ class SynthPatchStorageClass {
 
     static const uint8_t numberPatches = MAX_PATCHES;
     static const uint8_t patchSize = 11;
+    static const uint16_t bankSize = MAX_PATCHES * patchSize;
+
+    /*
+     * EEPROM layout per chip:
+     *   [magic][version] then per patch [patchSize bytes][crc8]
+     * A patch whose CRC does not match keeps its default values.
+     */
+    static const uint8_t storeMagic = 0xF2;
+    static const uint8_t storeVersion = 1;
+    static const uint8_t legacyMagic = 0xF1;
+    static const uint8_t headerSize = 2;
+    static const uint8_t recordSize = patchSize + 1;
+    static const uint16_t storeSize = headerSize + MAX_PATCHES * recordSize;
 
   private:
-    uint8_t selectedPatch;
+    enum { STORE_EMPTY, STORE_VALID };
+
+    void checkStore();
+    void readPatch(uint8_t patch, uint8_t * buffer);
+    uint8_t * stage(uint8_t patch);
+    void markDirty(uint8_t patch);
+    void passTurn();
+    int storeOffset() { return chipIndex * storeSize; }
+    static uint8_t crc(const uint8_t * data);
+
+    uint8_t selectedPatch = 0;
     uint8_t chipIndex = 0;
     uint8_t patchTemp[patchSize];
+    SynthVoiceParams tempParams;
+
+    // The patch load() compiled last, so a repeated keyTrig note is
+    // one apply(). Any change to that patch clears it.
+    SynthVoiceParams lastParams;
+    int8_t lastPatch = -1;
+
+    uint8_t storeState = STORE_EMPTY;       // set by init()
+
+    // pending[p] is patch p while its dirty bit is set. Slots in held
+    // were handed out by editBank() and wait for save() or revert().
+    uint8_t pending[MAX_PATCHES][patchSize];
+    uint16_t dirty = 0;
+    uint16_t held = 0;
+    bool headerDirty = false;
+    uint8_t flushPatch = 0;
+    uint8_t flushByte = 0;
+    uint8_t flushCrc = 0;
+
+    static uint8_t flushTurn;       // chipIndex of the instance at the EEPROM
+    static uint8_t instances;
 
-    static uint8_t bank[MAX_PATCHES][patchSize];
+    static const uint8_t defaultBank[MAX_PATCHES][patchSize] PROGMEM;
 };
 
 typedef SynthPatchStorageClass SynthPatchStorage;
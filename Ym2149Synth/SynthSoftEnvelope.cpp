@@ -76,7 +76,7 @@ bool SynthSoftEnvelopeClass::update()
     }
 
     if(lookupSize) {
-        value = lookupTable[phase];
+        value = pgm_read_byte(&lookupTable[phase]);
     } else {
         value = phase;
     }
@@ -107,11 +107,28 @@ uint8_t SynthSoftEnvelopeClass::getShape()
 
 void SynthSoftEnvelopeClass::setShape(uint8_t v)
 {
-    shape = v<<1;
-    size = (((((unsigned long)(shape&0x7F))<<5))/255);
-    increment = 1;
-    if(size == 0) {
-        increment = 255/((shape&0x7F)<<5);
+    SynthEnvelopeShape s;
+    compileShape(v, s);
+    setShape(s);
+}
+
+void SynthSoftEnvelopeClass::setShape(const SynthEnvelopeShape & s)
+{
+    shape = s.shape;
+    size = s.size;
+    increment = s.increment;
+}
+
+void SynthSoftEnvelopeClass::compileShape(uint8_t v, SynthEnvelopeShape & s)
+{
+    s.shape = v<<1;
+
+    // ((shape&0x7F)<<5)/255 without a long division, exact for this range
+    uint16_t n = ((uint16_t)(s.shape&0x7F))<<5;
+    s.size = (n + (n>>8) + 1)>>8;
+    s.increment = 1;
+    if(s.size == 0 && n) {
+        s.increment = 255/(uint8_t)n;
     }
 }
 
@@ -25,6 +25,13 @@
 
 #include "Arduino.h"
 
+// Precomputed form of a shape value, see SynthSoftEnvelopeClass::compileShape
+struct SynthEnvelopeShape {
+    uint8_t shape;
+    uint8_t increment;
+    uint16_t size;
+};
+
 class SynthSoftEnvelopeClass {
   public:
 
@@ -32,6 +39,8 @@ class SynthSoftEnvelopeClass {
     bool update();
     uint16_t read();
     void setShape(uint8_t v);
+    void setShape(const SynthEnvelopeShape & s);
+    static void compileShape(uint8_t v, SynthEnvelopeShape & s);
     void setRange(uint16_t mn, uint16_t mx);
     void setLookupTable(const uint8_t t[], uint8_t size);
     uint8_t getShape();
@@ -0,0 +1,175 @@
+/*
+ * Ym2149Synth
+ * http://trash80.com
+ * Copyright (c) 2016 Timothy Lamb
+ *
+ * This file is part of Ym2149Synth.
+ *
+ * Ym2149Synth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ym2149Synth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "SynthSysEx.h"
+
+void SynthSysExClass::begin(SynthPatchStorage * p, uint8_t count)
+{
+    patches = p;
+    patchCount = count;
+    valid = false;
+}
+
+void SynthSysExClass::onStart()
+{
+    dropBank();             // a message cut off without F7
+    valid = true;
+    header = 0;
+    packedPos = 0;
+    bankPos = 0;
+    sum = 0;
+}
+
+void SynthSysExClass::onData(uint8_t data)
+{
+    if(!valid) return;
+
+    if(header < 4) {
+        switch(header) {
+            case 0:
+                valid = data == manufacturerId;
+                break;
+            case 1:
+                valid = data == modelId;
+                break;
+            case 2:
+                command = data;
+                break;
+            case 3:
+                if(data == allBanks) {
+                    bank = 0;
+                    lastBank = patchCount - 1;
+                } else if(data < patchCount) {
+                    bank = lastBank = data;
+                } else {
+                    valid = false;
+                }
+                break;
+        }
+        header++;
+        return;
+    }
+
+    // Only bank data carries a payload, anything past the last block is junk
+    if(command != cmdBankData || bank > lastBank) {
+        valid = false;
+        return;
+    }
+
+    if(packedPos == packedSize) {
+        if(((sum + data) & 0x7F) == 0) {
+            patches[bank].save();
+        } else {
+            patches[bank].revert();
+        }
+        nextBank();
+        return;
+    }
+
+    if(!packedPos) {
+        target = patches[bank].editBank();
+    }
+
+    sum += data;
+    uint8_t groupPos = packedPos & 0x07;
+    if(!groupPos) {
+        highBits = data;
+    } else {
+        target[bankPos++] = data | (((highBits >> (groupPos - 1)) & 1) << 7);
+    }
+    packedPos++;
+}
+
+void SynthSysExClass::onEnd(MidiCallbackClass * midi)
+{
+    dropBank();
+    if(!valid || header < 4) return;
+
+    if(command == cmdDumpRequest) {
+        dump(midi, bank == lastBank ? bank : allBanks);
+    }
+    valid = false;
+}
+
+void SynthSysExClass::nextBank()
+{
+    bank++;
+    packedPos = 0;
+    bankPos = 0;
+    sum = 0;
+}
+
+// A block that did not reach its checksum leaves the cache half written
+void SynthSysExClass::dropBank()
+{
+    if(valid && header == 4 && command == cmdBankData && bank <= lastBank && packedPos) {
+        patches[bank].revert();
+    }
+    packedPos = 0;
+}
+
+void SynthSysExClass::dump(MidiCallbackClass * midi, uint8_t b)
+{
+    uint8_t first = b;
+    uint8_t last = b;
+
+    if(b == allBanks) {
+        first = 0;
+        last = patchCount - 1;
+    } else if(b >= patchCount) {
+        return;
+    }
+
+    uint8_t head[5] = { 0xF0, manufacturerId, modelId, cmdBankData, b };
+    midi->sendSysEx(head, 5);
+
+    for(uint8_t p = first; p <= last; p++) {
+        uint8_t patch[SynthPatchStorage::patchSize];
+
+        uint8_t checksum = 0;
+        for(uint16_t i = 0; i < SynthPatchStorage::bankSize; i += 7) {
+            uint8_t group[8];
+            uint8_t n = min(SynthPatchStorage::bankSize - i, 7);
+
+            group[0] = 0;
+            for(uint8_t j = 0; j < n; j++) {
+                uint16_t k = i + j;
+                if(k % SynthPatchStorage::patchSize == 0) {
+                    patches[p].getPatch(patch, k / SynthPatchStorage::patchSize);
+                }
+                uint8_t data = patch[k % SynthPatchStorage::patchSize];
+                group[0] |= (data >> 7) << j;
+                group[j + 1] = data & 0x7F;
+            }
+            for(uint8_t j = 0; j <= n; j++) {
+                checksum += group[j];
+            }
+            midi->sendSysEx(group, n + 1);
+        }
+
+        checksum = (0x80 - (checksum & 0x7F)) & 0x7F;
+        midi->sendSysEx(&checksum, 1);
+    }
+
+    uint8_t end = 0xF7;
+    midi->sendSysEx(&end, 1);
+}
@@ -0,0 +1,87 @@
+/*
+ * Ym2149Synth
+ * http://trash80.com
+ * Copyright (c) 2016 Timothy Lamb
+ *
+ * This file is part of Ym2149Synth.
+ *
+ * Ym2149Synth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ym2149Synth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SYNTHSYSEX_h
+#define SYNTHSYSEX_h
+
+#include "Arduino.h"
+#include "MidiCallback.h"
+#include "SynthPatchStorage.h"
+
+/*
+ * Bulk patch dump / load over SysEx.
+ *
+ *   F0 7D 59 <cmd> <bank> [payload] F7
+ *
+ *   cmd 0x01  dump request, no payload
+ *   cmd 0x02  bank data, payload is one block per bank
+ *   bank      0-2 for a single chip bank, 0x7F for all three
+ *
+ * A block is the bank (16 x 11 bytes) packed 7 bytes into 8: a byte
+ * holding the high bits of the following 7, then the 7 low parts.
+ * Each block ends with a checksum that brings the sum of the packed
+ * block to 0 (mod 128) and is committed only if it verifies.
+ *
+ * A block is decoded straight into the bank's pending slots, which the
+ * EEPROM takes in the background (see SynthPatchStorage), so an
+ * all-banks message never waits for the EEPROM.
+ */
+class SynthSysExClass {
+  public:
+    void begin(SynthPatchStorage * patches, uint8_t count);
+    void onStart();
+    void onData(uint8_t data);
+    void onEnd(MidiCallbackClass * midi);
+    void dump(MidiCallbackClass * midi, uint8_t bank);
+
+    static const uint8_t manufacturerId = 0x7D;
+    static const uint8_t modelId = 0x59;
+    static const uint8_t cmdDumpRequest = 0x01;
+    static const uint8_t cmdBankData = 0x02;
+    static const uint8_t allBanks = 0x7F;
+
+    static const uint16_t packedSize =
+        (SynthPatchStorage::bankSize / 7) * 8 +
+        (SynthPatchStorage::bankSize % 7 ? SynthPatchStorage::bankSize % 7 + 1 : 0);
+
+  private:
+    void nextBank();
+    void dropBank();
+
+    SynthPatchStorage * patches;
+    uint8_t patchCount;
+
+    bool valid;
+    uint8_t header;
+    uint8_t command;
+    uint8_t bank;
+    uint8_t lastBank;
+    uint16_t packedPos;
+    uint16_t bankPos;
+    uint8_t highBits;
+    uint8_t sum;
+    uint8_t * target;       // the bank being received, SynthPatchStorage::editBank()
+};
+
+typedef SynthSysExClass SynthSysEx;
+
+#endif
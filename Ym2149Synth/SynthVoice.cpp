@@ -33,6 +33,9 @@
  * For SoftSynth pitch "softFreqTable":
  * function nf(n) {return Math.round((Math.pow(2,(((n) - 69)/12)) * 440.0) * (1.0/22050) * 100000);};var out = [];for(var i =0; i<128; i += 0.1) out.push(nf(i));copy(out.toString());console.log("Data in copybuffer. Array size is "+out.length);
  *
+ * For Vibrato "vibratoIncrementTable" (rate CC 0-127 to increment per event tick):
+ * var out = [];for(var v=0; v<128; v++) out.push(Math.floor(10000/Math.floor(Math.pow(8000, 1-v/127)+5)));copy(out.toString());
+ *
  * For Volume Envelope Table :
  * size=256;function nf(n) {return Math.round(Math.pow(n, 1.75) * 255);};var out = [];for(var i =0; i<size; i += 1) out.push(nf(i/size));copy(out.toString());console.log("Data in copybuffer. Array size is "+out.length);
  *
@@ -53,6 +56,10 @@ const static uint8_t volumeEnvelopeTable[256] PROGMEM = {
     0,0,0,0,0,0,0,0,1,1,1,1,1,1,2,2,2,2,2,3,3,3,3,4,4,4,5,5,5,6,6,6,7,7,7,8,8,9,9,9,10,10,11,11,12,12,13,13,14,14,15,15,16,16,17,17,18,18,19,20,20,21,21,22,23,23,24,24,25,26,26,27,28,28,29,30,30,31,32,33,33,34,35,36,36,37,38,39,39,40,41,42,43,43,44,45,46,47,48,48,49,50,51,52,53,54,55,55,56,57,58,59,60,61,62,63,64,65,66,67,68,69,70,71,72,73,74,75,76,77,78,79,80,81,82,83,84,85,86,88,89,90,91,92,93,94,95,97,98,99,100,101,102,104,105,106,107,108,110,111,112,113,114,116,117,118,119,121,122,123,125,126,127,128,130,131,132,134,135,136,138,139,140,142,143,144,146,147,149,150,151,153,154,156,157,158,160,161,163,164,166,167,168,170,171,173,174,176,177,179,180,182,183,185,186,188,189,191,192,194,196,197,199,200,202,203,205,207,208,210,211,213,215,216,218,220,221,223,224,226,228,229,231,233,234,236,238,240,241,243,245,246,248,250,252,255
 };
 
+const static int16_t vibratoIncrementTable[128] PROGMEM = {
+    1,1,1,1,1,1,1,2,2,2,2,2,2,3,3,3,3,4,4,4,5,5,5,6,6,7,7,8,9,9,10,11,11,12,13,14,15,17,18,19,21,22,24,25,27,29,31,34,36,39,42,45,48,51,55,59,63,68,72,78,84,90,96,103,109,117,126,135,142,153,163,175,185,200,212,227,243,256,270,294,312,333,344,370,400,416,434,476,500,526,555,588,625,625,666,714,769,769,833,833,909,909,1000,1000,1000,1111,1111,1111,1250,1250,1250,1250,1428,1428,1428,1428,1428,1428,1666,1666,1666,1666,1666,1666,1666,1666,1666,1666
+};
+
 #define map_int16(x, in_min, in_max, out_min, out_max) ((x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min)
 
 void SynthVoice::begin(YM2149 * ym, uint8_t ch, uint8_t sy)
@@ -61,8 +68,8 @@ void SynthVoice::begin(YM2149 * ym, uint8_t ch, uint8_t sy)
     chip = ch;   // chip index (YM 0/1/2)
     synth = sy;  // voice index (A/B/C)
 
-    enableVoice = true;
-    enableSoftsynth = true;
+    params.enableVoice = true;
+    params.enableSoftsynth = true;
 
     Ym->setNoise(chip, synth, 0);
     Ym->setEnv(chip, synth, 0);
@@ -76,14 +83,14 @@ void SynthVoice::begin(YM2149 * ym, uint8_t ch, uint8_t sy)
     pitchEnvelope.setShape(0x00);
     pitchEnvelope.setRange(0,0);
 
-    synthType = 255;
+    params.synthType = 255;
     setSynthType(0);
 }
 
 void SynthVoice::updateSoftsynth()
 {
     //@TODO optimize this, used fixed.h for fixed point math
-    if(!enableSoftsynth || volume <= 0) {
+    if(!params.enableSoftsynth || volume <= 0) {
         return;
     }
 
@@ -92,7 +99,7 @@ void SynthVoice::updateSoftsynth()
     if(softPhase > 100000) softPhase -= 100000;
     if(softPhase < 0) softPhase += 100000;
 
-    if(softPhase >= softWidth) {
+    if(softPhase >= params.softWidth) {
         if(softWavPos) {
             softWavPos = 0;
             Ym->setVolume(chip,synth,volume);
@@ -105,10 +112,45 @@ void SynthVoice::updateSoftsynth()
     }
 }
 
+/*
+ * Per synth type flags, fixed at compile time so each type gets its own
+ * updateEvents body without the flag tests.
+ */
+template<uint8_t N> struct SynthTypeTraits;
+
+#define SYNTH_TYPE(N, VOICE, SOFT, DETUNE, NOISE, ENV, MODONLY, ENVTYPE) \
+    template<> struct SynthTypeTraits<N> { \
+        static const bool voice = VOICE; \
+        static const bool softsynth = SOFT; \
+        static const bool softDetune = DETUNE; \
+        static const bool noise = NOISE; \
+        static const bool env = ENV; \
+        static const bool pitchModOnly = MODONLY; \
+        static const uint8_t envType = ENVTYPE; \
+    };
+
+//         type voice  soft   detune noise  env    modOnly envType
+SYNTH_TYPE(0,   true,  false, false, false, false, false,  0) // Square
+SYNTH_TYPE(1,   true,  false, false, false, true,  true,   1) // Square + Env Saw
+SYNTH_TYPE(2,   true,  false, false, false, true,  true,   2) // Square + Env Triangle
+SYNTH_TYPE(3,   false, false, false, false, true,  false,  2) // Env Triangle
+SYNTH_TYPE(4,   false, false, false, false, true,  false,  1) // Env Saw
+SYNTH_TYPE(5,   true,  true,  true,  false, false, false,  0) // Square + Softwave
+SYNTH_TYPE(6,   true,  true,  false, false, false, true,   0) // Square + Softwave, acid
+SYNTH_TYPE(7,   false, false, false, true,  false, false,  0) // Noise
+
+#undef SYNTH_TYPE
+
 void SynthVoice::updateEvents()
+{
+    params.update(this);
+}
+
+template<class T>
+void SynthVoice::updateEventsFor()
 {
     //@TODO optimize this, used fixed.h for fixed point math
-    uint16_t voiceF = currentNoteFreq+transpose;
+    uint16_t voiceF = currentNoteFreq+params.transpose;
 
 
     uint16_t envF = 0;
@@ -117,7 +159,7 @@ void SynthVoice::updateEvents()
     if(playing) {
 
         if(glideActive) {
-            uint16_t destF  = noteFreq+transpose;
+            uint16_t destF  = noteFreq+params.transpose;
             glidePhase += glideIncrement;
             if(destF > voiceF) {
                 voiceF += (glidePhase/1000);
@@ -144,14 +186,14 @@ void SynthVoice::updateEvents()
 
         envF = softF = voiceF;
 
-        if(vibratoAmount && currentNoteFreq) {
-            vibratoPhase += vibratoIncrement;
+        if(params.vibratoAmount && currentNoteFreq) {
+            vibratoPhase += params.vibratoIncrement;
             if(vibratoPhase > 10000) vibratoPhase -= 20000;
             if(vibratoPhase < -10000) vibratoPhase += 20000;
-            voiceF += map_int16(((abs(vibratoPhase) * 2) - 10000), -10000, 10000, vibratoAmount*-1, vibratoAmount)/100;
+            voiceF += map_int16(((abs(vibratoPhase) * 2) - 10000), -10000, 10000, params.vibratoAmount*-1, params.vibratoAmount)/100;
         }
 
-        if(pitchEnvAmount) {
+        if(params.pitchEnvAmount) {
             pitchEnvelope.update();
             uint16_t pitchEnvAmt = pitchEnvelope.read();
             voiceF += pitchEnvAmt;
@@ -160,33 +202,33 @@ void SynthVoice::updateEvents()
         if(voiceF != lastNoteFreq) {
             lastNoteFreq = voiceF;
 
-            if(!voicePitchModOnly) {
+            if(!T::pitchModOnly) {
                 envF = softF = voiceF;
             }
 
-            if(enableSoftsynth) {
+            if(T::softsynth) {
                 uint16_t sf = softF;
-                if(enableSoftDetune) sf +=pwmFreq+softFreqDetune;
+                if(T::softDetune) sf +=params.pwmFreq+params.softFreqDetune;
                 if(sf>=tableSize) sf = tableSize-1;
-                softIncrement = softFreqTable[sf];
+                softIncrement = pgm_read_word(&softFreqTable[sf]);
             }
 
-            if(enableEnv) {
-                if(voicePitchModOnly) {
+            if(T::env) {
+                if(T::pitchModOnly) {
                     // Acid on the pitch Envelope
-                    Ym->setTone(chip,synth,freqTable[voiceF+(softFreqDetune>>1)]);
-                    Ym->setTone(chip,4,freqTable[envF+pwmFreq]);
+                    Ym->setTone(chip,synth,pgm_read_word(&freqTable[voiceF+(params.softFreqDetune>>1)]));
+                    Ym->setTone(chip,4,pgm_read_word(&freqTable[envF+params.pwmFreq]));
                 } else {
-                    Ym->setTone(chip,4,freqTable[voiceF+pwmFreq]);
+                    Ym->setTone(chip,4,pgm_read_word(&freqTable[voiceF+params.pwmFreq]));
                 }
-            } else if (enableVoice) {
-                if(voicePitchModOnly) {
-                    Ym->setTone(chip,synth,freqTable[voiceF+(softFreqDetune>>1)]);
+            } else if (T::voice) {
+                if(T::pitchModOnly) {
+                    Ym->setTone(chip,synth,pgm_read_word(&freqTable[voiceF+(params.softFreqDetune>>1)]));
                 } else {
-                    Ym->setTone(chip,synth,freqTable[voiceF]);
+                    Ym->setTone(chip,synth,pgm_read_word(&freqTable[voiceF]));
                 }
             }
-            if (enableNoise) {
+            if (T::noise) {
                 Ym->setTone(chip,3,0x1F - (((uint8_t)(voiceF/10))>>2));
             }
         }
@@ -196,16 +238,16 @@ void SynthVoice::updateEvents()
             if(volume == 0 && volumeEnvelope.getShape() & 0x80) {
                 playing = false;
             }
-            if(!enableSoftsynth)
+            if(!T::softsynth)
                 Ym->setVolume(chip,synth,volume);
         }
 
-        if(noiseDelay && !noiseDelayTriggered) {
+        if(params.noiseDelay && !noiseDelayTriggered) {
             noiseDelayPhase += 1;
-            if(noiseDelayPhase >= noiseDelayIncrement) {
+            if(noiseDelayPhase >= params.noiseDelayIncrement) {
                 noiseDelayPhase = 0;
                 noiseDelayTriggered = true;
-                if(!enableNoise) {
+                if(!T::noise) {
                     Ym->setNoise(chip,synth,2);
                 } else {
                     Ym->setNoise(chip,synth,0);
@@ -215,6 +257,12 @@ void SynthVoice::updateEvents()
     }
 }
 
+template<class T>
+void SynthVoice::dispatch(SynthVoiceClass * voice)
+{
+    voice->updateEventsFor<T>();
+}
+
 void SynthVoice::playNote(uint8_t n, uint8_t v)
 {
     //@TODO refactor this
@@ -234,12 +282,12 @@ void SynthVoice::playNote(uint8_t n, uint8_t v)
             glidePhase = 0;
             glideActive= false;
         } else {
-            if(glide) {
+            if(params.glide) {
                 if(glideActive) currentNoteFreq = lastNoteFreq;
                 glideActive = true;
                 glidePhase = 0;
 
-                glideIncrement = (((uint32_t)abs(noteFreq - currentNoteFreq))*10000)/glide;
+                glideIncrement = (((uint32_t)abs(noteFreq - currentNoteFreq))*10000)/params.glide;
                 if(!glideIncrement) glideIncrement = 1;
             } else {
                 glideIncrement = 0;
@@ -254,23 +302,23 @@ void SynthVoice::playNote(uint8_t n, uint8_t v)
         if(softIncrement > 1) softIncrement = 1;
         if(softIncrement < 0) softIncrement = 0;
 
-        if(!enableVoice) {
+        if(!params.enableVoice) {
             Ym->setNote(chip,synth,255);
         }
 
-        if(enableNoise) {
+        if(params.enableNoise) {
             Ym->setNoise(chip,synth,1);
         } else {
             noiseDelayTriggered = false;
-            enableNoise = false;
+            params.enableNoise = false;
             Ym->setNoise(chip,synth,0);
         }
         noiseDelayPhase = 0;
 
-        if(enableEnv) {
+        if(params.enableEnv) {
             Ym->setEnv(chip,synth,1);
             Ym->setEnvShape(chip,0,0,0,0);
-            if(envType == 1) {
+            if(params.envType == 1) {
                 Ym->setEnvShape(chip,1,0,0,0);
             } else {
                 Ym->setEnvShape(chip,1,0,1,0);
@@ -282,7 +330,7 @@ void SynthVoice::playNote(uint8_t n, uint8_t v)
     } else if(n == note) {
         playing = false;
         volume = 0;
-        if(enableEnv) {
+        if(params.enableEnv) {
             Ym->setEnv(chip,synth,0);
         }
         Ym->setVolume(chip,synth,0);
@@ -299,8 +347,8 @@ void SynthVoice::setPitchbend(int v)
 void SynthVoice::setGlide(uint8_t v)
 {
     //unsigned int ms = map(v, 0, 127, 0, 1000);
-    glide = v;
-    glide<<=6;
+    params.glide = v;
+    params.glide<<=6;
 }
 
 void SynthVoice::setVolumeEnvShape(uint8_t v)
@@ -316,28 +364,34 @@ void SynthVoice::setPitchEnvShape(uint8_t v)
 
 void SynthVoice::setPitchEnvAmount(uint8_t v)
 {
-    pitchEnvAmount = v;
-    pitchEnvAmount*= 10;
-    pitchEnvelope.setRange(0,pitchEnvAmount);
+    params.pitchEnvAmount = v;
+    params.pitchEnvAmount*= 10;
+    pitchEnvelope.setRange(0,params.pitchEnvAmount);
 }
 
 void SynthVoice::setVibratoAmount(uint8_t v)
 {
-    vibratoAmount = v*100;
+    params.vibratoAmount = v*100;
 }
 
 void SynthVoice::setVibratoFreq(uint8_t v)
 {
-    unsigned int ms = (pow(8000.0f,1.0f - ((float)v)/127.0f)) + 5;
-    vibratoIncrement = (1.0f/ms)*10000;
+    if(v > 127) v = 127;
+    params.vibratoIncrement = pgm_read_word(&vibratoIncrementTable[v]);
+}
+
+// ((v/255) + 0.5) * 100000, rounded down, without the float math
+uint32_t SynthVoice::pwmWidth(uint8_t v)
+{
+    return 50000UL + (uint32_t)v * 100000UL / 255;
 }
 
 void SynthVoice::setPwmFreq(uint8_t v)
 {
-    pwmFreq = v;
+    params.pwmFreq = v;
 
-    if(chip,synthType == 6) {
-        softWidth = (((float)(pwmFreq)/255) + 0.5) * 100000;
+    if(params.synthType == 6) {
+        params.softWidth = pwmWidth(v);
     }
     if(playing) {
         lastNoteFreq = 0;
@@ -346,8 +400,8 @@ void SynthVoice::setPwmFreq(uint8_t v)
 
 void SynthVoice::setSoftDetune(uint8_t v)
 {
-    softFreqDetune = v;
-    softFreqDetune *= 10;
+    params.softFreqDetune = v;
+    params.softFreqDetune *= 10;
     if(playing) {
         lastNoteFreq = 0;
     }
@@ -355,84 +409,130 @@ void SynthVoice::setSoftDetune(uint8_t v)
 
 void SynthVoice::setNoiseDelay(uint8_t v)
 {
-    noiseDelay = v;
+    params.noiseDelay = v;
     v = 127 - v;
-    noiseDelayIncrement = v<<1;
+    params.noiseDelayIncrement = v<<1;
 }
 
 void SynthVoice::setTranspose(uint8_t v)
 {
     if(!v) v = 64;
-    transpose = (((int)v) - 64) * 10;
+    params.transpose = (((int)v) - 64) * 10;
 }
 
 void SynthVoice::setSynthType(uint8_t v)
 {
-    if(v == synthType) return;
+    if(v == params.synthType) return;
 
-    synthType = v;
+    changeSynthType();
+    compileSynthType(v, params);
+    retrigger();
+}
 
-    if(enableNoise) Ym->setNoise(chip,synth,0);
-    if(enableEnv) Ym->setEnv(chip,synth,0);
+// Releases the YM state owned by the current synth type
+void SynthVoice::changeSynthType()
+{
+    if(params.enableNoise) Ym->setNoise(chip,synth,0);
+    if(params.enableEnv) Ym->setEnv(chip,synth,0);
+}
 
-    enableVoice = false;
-    enableSoftsynth = false;
-    enableEnv   = false;
-    envType     = 0;
-    enableNoise = false;
-    enableSoftDetune = false;
-    voicePitchModOnly = false;
+void SynthVoice::retrigger()
+{
+    if(playing) {
+        lastNoteFreq = 0;
+        playing = false;
+        playNote(note, velocity);
+    }
+}
+
+template<class T>
+void SynthVoice::compileSynthType(SynthVoiceParams & p)
+{
+    p.enableVoice = T::voice;
+    p.enableSoftsynth = T::softsynth;
+    p.enableSoftDetune = T::softDetune;
+    p.enableNoise = T::noise;
+    p.enableEnv = T::env;
+    p.voicePitchModOnly = T::pitchModOnly;
+    p.envType = T::envType;
+    p.update = &dispatch<T>;
+}
 
-    switch(chip,synthType)
+void SynthVoice::compileSynthType(uint8_t v, SynthVoiceParams & p)
+{
+    p.synthType = v;
+
+    switch(p.synthType)
     {
-        case 0:
-            enableVoice = true;
-        break;
-        case 1:
-            voicePitchModOnly = true;
-            enableVoice = true;
-            enableEnv   = true;
-            envType     = 1;
-        break;
-        case 2:
-            voicePitchModOnly = true;
-            enableVoice = true;
-            enableEnv   = true;
-            envType     = 2;
-        break;
-        case 3:
-            enableVoice = false;
-            enableEnv   = true;
-            envType     = 2;
-        break;
-        case 4:
-            enableVoice = false;
-            enableEnv   = true;
-            envType     = 1;
-        break;
+        case 1: compileSynthType<SynthTypeTraits<1> >(p); break;
+        case 2: compileSynthType<SynthTypeTraits<2> >(p); break;
+        case 3: compileSynthType<SynthTypeTraits<3> >(p); break;
+        case 4: compileSynthType<SynthTypeTraits<4> >(p); break;
         case 5:
-            enableVoice = true;
-            enableSoftsynth = true;
-            enableSoftDetune  = true;
-            softWidth = 50000;
+            compileSynthType<SynthTypeTraits<5> >(p);
+            p.softWidth = 50000;
         break;
         case 6:
-            enableVoice = true;
-            enableSoftsynth = true;
-            voicePitchModOnly = true;
-            enableSoftDetune  = false;
-            softWidth = (((float)(pwmFreq)/255) + 0.5) * 100000;
-        break;
-        case 7:
-            enableNoise = true;
+            compileSynthType<SynthTypeTraits<6> >(p);
+            p.softWidth = pwmWidth(p.pwmFreq);
         break;
+        case 7: compileSynthType<SynthTypeTraits<7> >(p); break;
+        case 0:
         default:
-            enableVoice = true;
+            compileSynthType<SynthTypeTraits<0> >(p);
         break;
     }
-    if(playing) {
+}
+
+/*
+ * Turns a stored patch (the CC1-CC11 values, in order) into the block
+ * apply() copies into the voice. Same results as calling the setters.
+ */
+void SynthVoice::compile(const uint8_t * patch, SynthVoiceParams & p)
+{
+    uint8_t v;
+
+    p.pwmFreq = patch[0];
+    p.softFreqDetune = patch[1] * 10;
+    p.softWidth = 0;
+    compileSynthType(patch[2], p);
+
+    v = patch[3];
+    if(v == 64) v = 65;
+    SynthSoftEnvelope::compileShape(v, p.volumeEnvShape);
+
+    p.glide = ((uint16_t)patch[4]) << 6;
+
+    v = patch[5] > 127 ? 127 : patch[5];
+    p.vibratoIncrement = pgm_read_word(&vibratoIncrementTable[v]);
+    p.vibratoAmount = patch[6] * 100;
+
+    p.noiseDelay = patch[7];
+    v = 127 - patch[7];
+    p.noiseDelayIncrement = v<<1;
+
+    p.pitchEnvAmount = patch[8] * 10;
+    SynthSoftEnvelope::compileShape(patch[9], p.pitchEnvShape);
+
+    v = patch[10] ? patch[10] : 64;
+    p.transpose = (((int)v) - 64) * 10;
+}
+
+void SynthVoice::apply(const SynthVoiceParams & p)
+{
+    bool typeChanged = p.synthType != params.synthType;
+
+    if(typeChanged) changeSynthType();
+
+    memcpy(&params, &p, sizeof(params));
+
+    volumeEnvelope.setShape(params.volumeEnvShape);
+    pitchEnvelope.setShape(params.pitchEnvShape);
+    pitchEnvelope.setRange(0,params.pitchEnvAmount);
+
+    if(typeChanged) {
+        retrigger();
+    } else if(playing) {
         lastNoteFreq = 0;
-        playing = false;
-        playNote(note, velocity);
     }
 }
@@ -27,6 +27,44 @@
 #include "YM2149.h"
 #include "SynthSoftEnvelope.h"
 
+/*
+ * Everything a patch sets on a voice, in the form the voice reads it at
+ * runtime. Compiling a patch does all the lookups once so applying it on
+ * note-on is a copy plus the register writes of a synth type change.
+ */
+class SynthVoiceClass;
+
+struct SynthVoiceParams {
+    uint8_t synthType;
+
+    // updateEvents specialised for synthType
+    void (*update)(SynthVoiceClass * voice);
+
+    bool enableVoice;
+    bool enableSoftsynth;
+    bool enableSoftDetune;
+    bool enableNoise;
+    bool enableEnv;
+    bool voicePitchModOnly;
+    uint8_t envType;
+
+    uint32_t softWidth;
+
+    uint16_t pwmFreq;
+    uint16_t softFreqDetune;
+    uint16_t pitchEnvAmount;
+    uint16_t glide;
+    int vibratoAmount;
+    int vibratoIncrement;
+    int transpose;
+
+    uint8_t noiseDelay;
+    uint16_t noiseDelayIncrement;
+
+    SynthEnvelopeShape volumeEnvShape;
+    SynthEnvelopeShape pitchEnvShape;
+};
+
 class SynthVoiceClass {
   public:
 
@@ -51,25 +89,26 @@ class SynthVoiceClass {
     void setSoftDetune(uint8_t v);
     void setSynthType(uint8_t v);
 
+    void apply(const SynthVoiceParams & p);
+    static void compile(const uint8_t * patch, SynthVoiceParams & p);
+
   private:
+    static void compileSynthType(uint8_t v, SynthVoiceParams & p);
+    template<class T> static void compileSynthType(SynthVoiceParams & p);
+    template<class T> static void dispatch(SynthVoiceClass * voice);
+    template<class T> void updateEventsFor();
+    static uint32_t pwmWidth(uint8_t v);
+    void changeSynthType();
+    void retrigger();
+
     YM2149 * Ym;
     uint8_t chip;
     uint8_t synth;
 
-    uint8_t synthType;
-
-    bool enableVoice;
-    bool enableSoftsynth;
-    bool enableSoftDetune;
-    bool enableNoise;
-    bool enableEnv;
-    bool voicePitchModOnly;
-
-    uint8_t envType;
+    SynthVoiceParams params;
 
     uint32_t softPhase;
     uint16_t softIncrement;
-    uint32_t softWidth;
     uint8_t softWavPos;
 
     int volume;
@@ -80,25 +119,15 @@ class SynthVoiceClass {
     uint16_t currentNoteFreq;
     uint16_t lastNoteFreq;
 
-    int transpose;
     int bendWheel;
 
-    uint16_t pitchEnvAmount;
-    uint16_t softFreqDetune;
-    uint16_t pwmFreq;
-
     bool glideActive;
-    uint16_t glide;
     uint16_t glideIncrement;
     uint32_t glidePhase;
 
-    int vibratoAmount;
     int vibratoPhase;
-    int vibratoIncrement;
 
-    uint8_t noiseDelay;
     bool noiseDelayTriggered;
-    uint16_t noiseDelayIncrement;
     uint16_t noiseDelayPhase;
 
 };
@@ -1,14 +0,0 @@
-#ifndef UPDATE_EFFECTS_H
-#define UPDATE_EFFECTS_H
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-void updateEffects(void); // __attribute__((signal, naked));
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif
\ No newline at end of file
@@ -1,26 +1,38 @@
 #pragma once
 #include <Arduino.h>
+#include "YMBoard.h"
+
+// Whole cycles at F_CPU that cover ns, less the cycles of the instruction
+// that ends the phase
+constexpr uint8_t ymBusCycles(uint32_t ns, uint8_t overhead)
+{
+    return (uint64_t(ns) * F_CPU + 999999999) / 1000000000 > overhead
+         ? (uint64_t(ns) * F_CPU + 999999999) / 1000000000 - overhead
+         : 0;
+}
 
 class YM2149Class {
 
 public:
-    static constexpr uint8_t DATA_PINS_D = 0b11111100; // D2-D7
-    static constexpr uint8_t DATA_PINS_B = 0b00000011; // D8-D9
-    static constexpr uint8_t BC1_BIT = _BV(PB6);    // D10 → PB6
-    static constexpr uint8_t BDIR_BIT = _BV(PF5);   // D20 → PF5
-    static constexpr uint8_t SEL_A_BIT = _BV(PF4);  // A3 → PF4
-    static constexpr uint8_t SEL_B_BIT = _BV(PF6);  // A1 → PF6
-    static constexpr uint8_t SEL_C_BIT = _BV(PF7);  // A0 → PF7
-    static constexpr uint8_t ENABLE_BIT = _BV(PF5); // A2 → PF5
-
-    /* -------- physical pins -------- */
-    static constexpr uint8_t PIN_BC1   = 10;
-    static constexpr uint8_t PIN_BDIR  = 20;
-    static constexpr uint8_t PIN_SEL_A = A3;
-    static constexpr uint8_t PIN_SEL_B = A1;
-    static constexpr uint8_t PIN_SEL_C = A0;
-    static constexpr uint8_t PIN_ENABLE= A2;
-    static constexpr uint8_t CHIP_LED[3] = {15, 14, 16};
+    // Pin assignment, see YMBoard.h
+    typedef YMBoardBus Bus;
+
+    /* -------- bus timing --------
+     * Minimums from the YM2149 / AY-3-8910 data sheets. writeFast() holds
+     * each phase for the cycles these come to at F_CPU, so writes are as
+     * short as the chip allows at 8, 16 or 20 MHz alike. A port bit
+     * set or clear (sbi/cbi) takes 2 cycles and ends each phase. */
+    static constexpr uint16_t ADDRESS_PULSE_NS = 300;  // BDIR+BC1 high
+    static constexpr uint16_t ADDRESS_HOLD_NS  = 100;  // DA kept after BDIR falls
+    static constexpr uint16_t DATA_PULSE_NS    = 500;  // BDIR high to write
+    static constexpr uint16_t DATA_ACCESS_NS   = 400;  // BC1 high to valid read data
+    static constexpr uint8_t  PORT_BIT_CYCLES  = 2;
+
+    // 3, 0 and 6 cycles at 16 MHz
+    static constexpr uint8_t ADDRESS_PULSE_CYCLES = ymBusCycles(ADDRESS_PULSE_NS, PORT_BIT_CYCLES);
+    static constexpr uint8_t ADDRESS_HOLD_CYCLES  = ymBusCycles(ADDRESS_HOLD_NS, PORT_BIT_CYCLES);
+    static constexpr uint8_t DATA_PULSE_CYCLES    = ymBusCycles(DATA_PULSE_NS, PORT_BIT_CYCLES);
+    static constexpr uint8_t DATA_ACCESS_CYCLES   = ymBusCycles(DATA_ACCESS_NS, 0);
 
     /* -------- YM registers -------- */
     static const uint8_t REG_A_FREQ = 0x00;
@@ -38,18 +50,75 @@ public:
 
     static constexpr float YM_CLOCK_HZ = 500000.0f;
 
-    static constexpr uint8_t LED_ON = LOW;
-    static constexpr uint8_t LED_OFF = HIGH;
-
     static constexpr uint8_t YM_0 = 0;
     static constexpr uint8_t YM_1 = 1;
     static constexpr uint8_t YM_2 = 2;
 
     void begin();
-    void selectYM(uint8_t chip);
-    void busWrite(uint8_t value);
-    void writeFast(uint8_t address, uint8_t value);
+    static void selectYM(uint8_t chip);
+
+    // Selects chip unless it is already selected. The main loop calls
+    // this with interrupts off (write() does), the ISRs as they are.
+    static inline void select(uint8_t chip)
+    {
+        if (chip != currentChip)
+        {
+            selectYM(chip);
+            currentChip = chip;
+        }
+    }
+
+    static inline void busWrite(uint8_t value) { Bus::writeData(value); }
+    static void writeFast(uint8_t address, uint8_t value);    // to the selected chip
     void write(uint8_t chip, uint8_t address, uint8_t value);
+
+    // writeFast() with the phases held for the given cycles instead
+    template <uint8_t AddressPulse, uint8_t AddressHold, uint8_t DataPulse>
+    static void writeTimed(uint8_t address, uint8_t value);
+
+    // Read back: latches the address, turns the data pins around and
+    // samples what the chip drives with BC1 high and BDIR low. Direct
+    // bus access, so not while an ISR owns the bus (setQueued).
+    uint8_t read(uint8_t chip, uint8_t address);
+    static uint8_t busRead();
+
+    // Bus stress test, also direct. Writes pseudo-random values to
+    // every chip with the bus timing at 4x, 2x and 1x the data sheet,
+    // then half and none, reads each value back and prints one line
+    // per step on Serial, then the fastest error-free rate. Levels and
+    // envelope shape are left alone, so it is silent; the registers it
+    // wrote hold junk afterwards.
+    void benchmark();
+
+    // Write queue for the main loop: a tick's writes are collected per
+    // chip and flush() sends them chip by chip, starting with the chip
+    // already selected, so each chip is selected at most once per tick.
+    // Registers go out in ascending order; one queued twice in a tick
+    // is written once with the last value, so envelope retriggers
+    // (R13 written twice) must use write().
+    void queue(uint8_t chip, uint8_t address, uint8_t value);
+    void flush();
+
+    // ISR bus ownership. After setQueued(true), write() no longer
+    // drives the bus: it appends to a lock-free single producer,
+    // single consumer ring and service(), called from the timer ISR
+    // that owns the bus, sends up to BUS_CHUNK writes per call. The
+    // producer is the main loop, or the song ISR while a song plays;
+    // the two never write at the same time. A full ring makes write()
+    // wait for the ISR, so it must not be called with interrupts off.
+    //
+    // Nothing outside the ISR disables interrupts for the bus any more,
+    // so its entry latency no longer includes a 14 write burst from the
+    // main loop. A 32 µs tick does at most BUS_CHUNK queued writes plus
+    // the effect writes, and a queued write reaches the chip within
+    // BUS_QUEUE_SIZE / BUS_CHUNK ticks (1 ms).
+    static constexpr uint8_t BUS_QUEUE_SIZE = 64;   // power of two
+    static constexpr uint8_t BUS_CHUNK = 2;
+
+    void setQueued(bool on) { queued = on; }
+    bool busIdle() const { return busHead == busTail; }
+    void service();
+
     void setPin(uint8_t chip, uint8_t pin, bool value);
     uint8_t getPin(uint8_t chip, uint8_t pin);
 
@@ -67,11 +136,27 @@ public:
     void setNoise(uint8_t chip, uint8_t voice, uint8_t value);
     void setEnv(uint8_t chip, uint8_t voice, uint8_t value);
     void setEnvShape(uint8_t chip, uint8_t cont, uint8_t att, uint8_t alt, uint8_t hold);
+    void setMixer(uint8_t chip, uint8_t value);    // tone/noise bits 0-5, ports kept
     void mute(uint8_t chip);
 
     volatile static uint8_t currentChip;
+    volatile static uint32_t selectCount;  // selectYM() calls, ISR_PROFILE builds
 
 private:
+    void push(uint8_t chip, uint8_t address, uint8_t value);
+
+    struct BusWrite {
+        uint8_t chipReg;            // chip << 4 | register
+        uint8_t value;
+    };
+    BusWrite busQueue[BUS_QUEUE_SIZE];
+    volatile uint8_t busHead = 0;   // written by the producer only
+    volatile uint8_t busTail = 0;   // written by service() only
+    bool queued = false;
+
+    uint16_t queuedMask[3] = {0};
+    uint8_t queuedValue[3][16];
+
     uint8_t levelValue[3][3] = {{0}};
     uint8_t portAValue[3] = {0};
     uint8_t portBValue[3] = {0};
@@ -79,4 +164,23 @@ private:
     bool ledState[3] = {false, false, false};
 };
 
+template <uint8_t AddressPulse, uint8_t AddressHold, uint8_t DataPulse>
+inline void YM2149Class::writeTimed(uint8_t address, uint8_t value)
+{
+    busWrite(address & 0x1F);
+    Bus::BC1::set();
+    Bus::BDIR::set();              // latch address
+    __builtin_avr_delay_cycles(AddressPulse);
+    Bus::BDIR::clear();
+    Bus::BC1::clear();
+    __builtin_avr_delay_cycles(AddressHold);
+
+    // busWrite() computes before it stores, which covers the data hold
+    // after the strobe below too
+    busWrite(value);
+    Bus::BDIR::set();              // write data
+    __builtin_avr_delay_cycles(DataPulse);
+    Bus::BDIR::clear();
+}
+
 typedef YM2149Class YM2149;
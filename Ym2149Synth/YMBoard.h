@@ -0,0 +1,287 @@
+// benbaker76 (https://github.com/benbaker76)
+
+#ifndef YMBoard_h
+#define YMBoard_h
+
+#include "Arduino.h"
+
+// ----------------------------------------------------------
+// Board description: the AVR pin behind every YM2149 bus
+// signal, chip select line and chip LED. YMBus<Board> turns
+// it into port accesses at compile time (data bus scatter
+// and gather, DDR setup, select, LEDs), so a new board
+// revision is a new struct and every access stays a fixed
+// sequence of port instructions.
+// ----------------------------------------------------------
+
+#define YM_PORT(Name, X)                                              \
+    struct Name {                                                     \
+        static auto port() -> decltype((PORT##X)) { return PORT##X; } \
+        static auto ddr()  -> decltype((DDR##X))  { return DDR##X; }  \
+        static auto pin()  -> decltype((PIN##X))  { return PIN##X; }  \
+    };
+
+YM_PORT(YMPortB, B)
+YM_PORT(YMPortC, C)
+YM_PORT(YMPortD, D)
+YM_PORT(YMPortE, E)
+YM_PORT(YMPortF, F)
+
+#undef YM_PORT
+
+template <class Port, uint8_t Bit>
+struct YMPin {
+    typedef Port port;
+    static constexpr uint8_t mask = 1 << Bit;
+
+    static inline void set()   { Port::port() |= mask; }
+    static inline void clear() { Port::port() &= ~mask; }
+};
+
+template <class... Pins> struct YMPins {};
+
+// ----------------------------------------------------------
+// YM2149F Turbo Sound x3 (ATmega32U4)
+// ----------------------------------------------------------
+struct YMBoardTurboSoundX3 {
+    typedef YMPins<
+        YMPin<YMPortD, PD1>,    // DA0  D2
+        YMPin<YMPortD, PD0>,    // DA1  D3
+        YMPin<YMPortD, PD4>,    // DA2  D4
+        YMPin<YMPortC, PC6>,    // DA3  D5
+        YMPin<YMPortD, PD7>,    // DA4  D6
+        YMPin<YMPortE, PE6>,    // DA5  D7
+        YMPin<YMPortB, PB4>,    // DA6  D8
+        YMPin<YMPortB, PB5>     // DA7  D9
+    > Data;
+
+    typedef YMPin<YMPortB, PB6> BC1;    // D10
+    typedef YMPin<YMPortF, PF5> BDIR;   // D20 / A2
+
+    // The select lines carry selectCode(chip) in binary, A is bit 0
+    typedef YMPin<YMPortF, PF4> SelA;   // A3
+    typedef YMPin<YMPortF, PF6> SelB;   // A1
+    typedef YMPin<YMPortF, PF7> SelC;   // A0
+    static constexpr uint8_t selectCode(uint8_t chip) { return 2 - chip; }
+
+    typedef YMPins<
+        YMPin<YMPortB, PB1>,    // chip 0  D15
+        YMPin<YMPortB, PB3>,    // chip 1  D14
+        YMPin<YMPortB, PB2>     // chip 2  D16
+    > Leds;
+};
+
+#ifndef YM_BOARD
+#define YM_BOARD YMBoardTurboSoundX3
+#endif
+
+// ----------------------------------------------------------
+// Pin list helpers. Every test below is on template
+// arguments, so the compiler folds it away.
+// ----------------------------------------------------------
+template <class A, class B> struct YMSamePort { static constexpr bool value = false; };
+template <class A> struct YMSamePort<A, A> { static constexpr bool value = true; };
+
+// Mask of the pins of List on Port
+template <class Port, class List> struct YMPortMask;
+
+template <class Port>
+struct YMPortMask<Port, YMPins<>> {
+    static constexpr uint8_t value = 0;
+};
+
+template <class Port, class P, class... Rest>
+struct YMPortMask<Port, YMPins<P, Rest...>> {
+    static constexpr uint8_t value =
+        (YMSamePort<typename P::port, Port>::value ? P::mask : 0) |
+        YMPortMask<Port, YMPins<Rest...>>::value;
+};
+
+// Bit I of a value onwards to its pin on Port, and back
+template <class Port, uint8_t I, class List> struct YMPortBits;
+
+template <class Port, uint8_t I>
+struct YMPortBits<Port, I, YMPins<>> {
+    static inline uint8_t scatter(uint8_t) { return 0; }
+    static inline uint8_t gather(uint8_t)  { return 0; }
+};
+
+template <class Port, uint8_t I, class P, class... Rest>
+struct YMPortBits<Port, I, YMPins<P, Rest...>> {
+    typedef YMPortBits<Port, I + 1, YMPins<Rest...>> Next;
+    static constexpr bool here = YMSamePort<typename P::port, Port>::value;
+
+    static inline uint8_t scatter(uint8_t value)
+    {
+        return (here && (value & (1 << I)) ? P::mask : 0) | Next::scatter(value);
+    }
+
+    static inline uint8_t gather(uint8_t pins)
+    {
+        return (here && (pins & P::mask) ? 1 << I : 0) | Next::gather(pins);
+    }
+};
+
+// Pin number n of List, chosen at run time
+template <class List> struct YMPinSwitch;
+
+template <>
+struct YMPinSwitch<YMPins<>> {
+    static inline void write(uint8_t, bool) {}
+};
+
+template <class P, class... Rest>
+struct YMPinSwitch<YMPins<P, Rest...>> {
+    static inline void write(uint8_t n, bool on)
+    {
+        if (n == 0)
+        {
+            if (on) P::set(); else P::clear();
+        }
+        else
+            YMPinSwitch<YMPins<Rest...>>::write(n - 1, on);
+    }
+};
+
+// Pin number N of List, chosen at compile time
+template <class List, uint8_t N> struct YMPinAt;
+
+template <class P, class... Rest>
+struct YMPinAt<YMPins<P, Rest...>, 0> {
+    typedef P type;
+};
+
+template <class P, class... Rest, uint8_t N>
+struct YMPinAt<YMPins<P, Rest...>, N> {
+    typedef typename YMPinAt<YMPins<Rest...>, N - 1>::type type;
+};
+
+// ----------------------------------------------------------
+// Bus access generated from a board description
+// ----------------------------------------------------------
+template <class Board>
+struct YMBus {
+    typedef typename Board::BC1 BC1;
+    typedef typename Board::BDIR BDIR;
+    typedef typename Board::SelA::port SelectPort;
+
+    static_assert(YMSamePort<typename Board::SelB::port, SelectPort>::value &&
+                  YMSamePort<typename Board::SelC::port, SelectPort>::value,
+                  "select lines must share a port to switch in one write");
+
+    static constexpr uint8_t SELECT_MASK =
+        Board::SelA::mask | Board::SelB::mask | Board::SelC::mask;
+
+    static constexpr uint8_t selectBits(uint8_t chip)
+    {
+        return (Board::selectCode(chip) & 1 ? Board::SelA::mask : 0) |
+               (Board::selectCode(chip) & 2 ? Board::SelB::mask : 0) |
+               (Board::selectCode(chip) & 4 ? Board::SelC::mask : 0);
+    }
+
+    template <class Port>
+    static constexpr uint8_t dataMask() { return YMPortMask<Port, typename Board::Data>::value; }
+
+    template <class Port>
+    static constexpr uint8_t controlMask()
+    {
+        return YMPortMask<Port, YMPins<BC1, BDIR>>::value |
+               (YMSamePort<Port, SelectPort>::value ? SELECT_MASK : 0);
+    }
+
+    // One port's share of the data bus. A lone pin is a bit set or
+    // clear, several are one read-modify-write.
+    template <class Port>
+    static inline void writePort(uint8_t value)
+    {
+        constexpr uint8_t m = dataMask<Port>();
+        if (!m)
+            return;
+
+        uint8_t bits = YMPortBits<Port, 0, typename Board::Data>::scatter(value);
+        if (!(m & (m - 1)))
+        {
+            if (bits) Port::port() |= m; else Port::port() &= ~m;
+        }
+        else
+            Port::port() = (Port::port() & ~m) | bits;
+    }
+
+    template <class Port>
+    static inline uint8_t readPort()
+    {
+        return dataMask<Port>()
+             ? YMPortBits<Port, 0, typename Board::Data>::gather(Port::pin())
+             : 0;
+    }
+
+    template <class Port>
+    static inline void dataDirection(bool output)
+    {
+        constexpr uint8_t m = dataMask<Port>();
+        if (!m)
+            return;
+
+        if (output)
+            Port::ddr() |= m;
+        else
+        {
+            Port::ddr() &= ~m;
+            Port::port() &= ~m;     // no pull-ups
+        }
+    }
+
+    // All bus, select and LED pins outputs; control and select
+    // low, LEDs off (high)
+    template <class Port>
+    static inline void initPort()
+    {
+        constexpr uint8_t leds = YMPortMask<Port, typename Board::Leds>::value;
+        constexpr uint8_t outputs = dataMask<Port>() | controlMask<Port>() | leds;
+        if (!outputs)
+            return;
+
+        Port::ddr() |= outputs;
+        Port::port() = (Port::port() & ~controlMask<Port>()) | leds;
+    }
+
+    static inline void init()
+    {
+        initPort<YMPortB>(); initPort<YMPortC>(); initPort<YMPortD>();
+        initPort<YMPortE>(); initPort<YMPortF>();
+    }
+
+    static inline void writeData(uint8_t value)
+    {
+        writePort<YMPortB>(value); writePort<YMPortC>(value); writePort<YMPortD>(value);
+        writePort<YMPortE>(value); writePort<YMPortF>(value);
+    }
+
+    static inline uint8_t readData()
+    {
+        return readPort<YMPortB>() | readPort<YMPortC>() | readPort<YMPortD>() |
+               readPort<YMPortE>() | readPort<YMPortF>();
+    }
+
+    static inline void dataOutput(bool output)
+    {
+        dataDirection<YMPortB>(output); dataDirection<YMPortC>(output);
+        dataDirection<YMPortD>(output); dataDirection<YMPortE>(output);
+        dataDirection<YMPortF>(output);
+    }
+
+    static inline void select(uint8_t chip)
+    {
+        static const uint8_t bits[3] = { selectBits(0), selectBits(1), selectBits(2) };
+        SelectPort::port() = (SelectPort::port() & ~SELECT_MASK) | bits[chip];
+    }
+
+    static inline void setLed(uint8_t chip, bool on)
+    {
+        YMPinSwitch<typename Board::Leds>::write(chip, on);
+    }
+};
+
+typedef YMBus<YM_BOARD> YMBoardBus;
+
+#endif
@@ -2,39 +2,132 @@
 
 #include "YMPlayerSerial.h"
 #include "DigiDrum.h"
+#include "YMVolume.h"
+#include "YMStreamDecoder.h"
+#include <util/atomic.h>
 
 // http://leonard.oxg.free.fr/ymformat.html
 // http://lynn3686.com/ym3456_tidy.html
 
 SidState sid[3][3];
-DigiDrumState dd[3][3];
+DigiDrumVoice dd[3][3];
 
 void YMPlayerSerialClass::begin()
 {
     Ym.begin();
+    resetChips();
 
+    //Serial.begin(115_200);
+    Serial.begin(2000000);
+
+    // Effects run off Timer1 at clk/1, songs off Timer3 at clk/64
+    effectsProfile.begin("effects", &TCNT1, &TIFR1, _BV(OCF1A), 1);
+    songProfile.begin("song", &TCNT3, &TIFR3, _BV(OCF3A), 64);
+
+    // From here on the effects ISR is the only code on the bus, every
+    // other write goes through Ym's ring (see YM2149::service)
+    startEffectsTimer();
+    Ym.setQueued(true);
+}
+
+void YMPlayerSerialClass::resetChips()
+{
     for(int i = 0; i < 3; i++)
     {
         Ym.setPortIO(i, 1, 1);     // Both ports as outputs
         Ym.setPin(i, 0, 1);        // A0 high
         Ym.mute(i);                // Mute this chip
     }
+}
 
-    //Serial.begin(115_200);
-    Serial.begin(2000000);
+// Timer1 CTC at clk/1, one effects tick every ISR_PERIOD_US
+void YMPlayerSerialClass::startEffectsTimer()
+{
+    noInterrupts();
+    TCCR1A = 0;
+    TCCR1B = _BV(WGM12) | _BV(CS10);
+    OCR1A  = F_CPU / 1000000 * ISR_PERIOD_US - 1;
+    TCNT1  = 0;
+    TIMSK1 = _BV(OCIE1A);
+    interrupts();
+}
+
+// ──────────────────────────────────────────────────────────────────────────
+// Effect parameter handoff, see effectParams
+// ──────────────────────────────────────────────────────────────────────────
+EffectParams &YMPlayerSerialClass::editEffects()
+{
+    uint8_t seq = effectSeq;
+    EffectParams &fx = effectParams[(seq + 1) & 1];
+    fx = effectParams[seq & 1];
+    return fx;
+}
+
+void YMPlayerSerialClass::publishEffects()
+{
+    effectSeq = effectSeq + 1;
+}
+
+// Effects ISR: bring sid/dd up to the published parameters
+void YMPlayerSerialClass::loadEffects()
+{
+    const EffectParams &fx = effectParams[effectSeen & 1];
+
+    for (uint8_t c = 0; c < 3; ++c)
+        for (uint8_t v = 0; v < 3; ++v) {
+            const SidParams &sp = fx.sid[c][v];
+            SidState &s = sid[c][v];
+            if (sp.start != s.start) {
+                s.start  = sp.start;
+                s.phase  = sp.reload;
+                s.toggle = 0;
+            }
+            else if (s.phase > sp.reload)
+                s.phase = sp.reload;        // retuned shorter, flip on time
+
+            // a voice that stops gets the frame's volume back
+            if (s.active && !sp.active) {
+                Ym.select(c);
+                Ym.writeFast(YM2149::REG_A_LEVEL + v, sp.level);
+            }
+            s.active = sp.active;
+            s.level  = sp.level;
+            s.reload = sp.reload;
+
+            // a drum ends by itself; a start takes a free slot, or the
+            // one nearest its end, and a restart the drum's own slot
+            const DigiDrumParams &dp = fx.dd[c][v];
+            DigiDrumVoice &dv = dd[c][v];
+            if (dp.start != dv.start) {
+                dv.start = dp.start;
+
+                uint8_t n = dp.replace ? dv.last : 0;
+                for (uint8_t i = 1; i < DIGIDRUM_MIX && !dp.replace && dv.drum[n].active; ++i) {
+                    const DigiDrumState &a = dv.drum[i], &b = dv.drum[n];
+                    if (!a.active || a.end - a.pos < b.end - b.pos)
+                        n = i;
+                }
+
+                DigiDrumState &d = dv.drum[n];
+                d.active = true;
+                d.phase  = dp.reload;
+                d.pos    = dp.begin;
+                d.end    = dp.end;
+                dv.last  = n;
+            }
+            dv.drum[dv.last].reload = dp.reload;
+        }
 }
 
 // ──────────────────────────────────────────────────────────────────────────
-// Decode one Timer‑Synth (SIDVoice) or Digi‑Drum slot and update globals
+// Decode one Timer‑Synth (SIDVoice) or Digi‑Drum slot into fx
 // ──────────────────────────────────────────────────────────────────────────
-void YMPlayerSerialClass::decodeEffect(uint8_t chip, const uint8_t regs[16],
+void YMPlayerSerialClass::decodeEffect(EffectParams &fx, uint8_t chip, const uint8_t regs[16],
                                        uint8_t flagR, uint8_t timerR, uint8_t countR)
 {
     uint8_t flag  = regs[flagR];
     uint8_t vBits = (flag >> 4) & 0x03;
-    if (vBits == 0) return;
-
-    uint8_t v = vBits - 1;
+    uint8_t v = vBits - 1;                  // 255: the slot is idle
     EffectType type = (flagR == 1) ? EffectType::SIDVoice
                          : (flagR == 3) ? EffectType::DigiDrum
                          : EffectType::None;
@@ -44,32 +137,116 @@ void YMPlayerSerialClass::decodeEffect(uint8_t chip, const uint8_t regs[16],
     uint32_t ticks = uint32_t(tc + 1) * tpMul[tp];
 
     if (type == EffectType::SIDVoice) {
-        SidState &s = sid[chip][v];
-        s.active = true;
-        s.level  = min(tc & 0x1F, 15);
-        s.reload = ticks;
-        s.phase  = ticks;
-        s.toggle = 0;
+        // The slot drives one voice at most and the others stop. The
+        // voice it names retunes in place, so its square wave runs on
+        // across frames, and only starts over when it was off or the
+        // frame sets the restart flag.
+        for (uint8_t i = 0; i < 3; ++i) {
+            SidParams &s = fx.sid[chip][i];
+            if (i != v) {
+                s.active = false;
+                s.level  = regs[YM2149::REG_A_LEVEL + i] & regMask[YM2149::REG_A_LEVEL + i];
+                continue;
+            }
+            if (!s.active || (flag & SID_RESTART))
+                s.start++;
+            s.active = true;
+            s.level  = min(tc & 0x1F, 15);
+            s.reload = ticks;
+        }
     }
     else if (type == EffectType::DigiDrum) {
-        DigiDrumState &d = dd[chip][v];
-        d.reload = ticks;
-        d.phase  = ticks;
-        d.pos    = 0;
-        d.sample = regs[v + 8] & 0x1F;
+        // Every frame that names a drum starts it over, as ST-Sound
+        // does, and it stops by itself at the end of the sample. A
+        // drum named the frame before too restarts in its own slot
+        // (replace) rather than mixing in a second copy of itself. The
+        // flash lookups happen here, so the ISR only walks a pointer.
+        uint8_t sample = vBits ? regs[YM2149::REG_A_LEVEL + v] & 0x1F : 0xFF;
+
+        for (uint8_t i = 0; i < 3; ++i) {
+            DigiDrumParams &d = fx.dd[chip][i];
+            if (i != v || sample >= DIGIDRUM_COUNT) {
+                d.held = false;
+                continue;
+            }
+
+            d.reload  = max(ticks, (uint32_t)TICKS_ISR);
+            d.replace = d.held && d.sample == sample;
+            d.sample  = sample;
+            d.begin   = (const uint8_t *)pgm_read_ptr(&sampleAddress[sample]);
+            d.end     = d.begin + pgm_read_word(&sampleLen[sample]);
+            d.held    = true;
+            d.start++;
+        }
     }
 }
 
 void YMPlayerSerialClass::update()
 {
-    const int packetSize = 17;
-    byte buffer[packetSize];
+    // [chip 0-2][16 regs] for one chip, or [ALL_CHIPS][3 x 16 regs]
+    byte buffer[1 + FRAME_SIZE * 3];
+
+    if (Serial.readBytes((char*)buffer, 1) != 1)
+        return;
+
+    uint8_t chip = buffer[0];
+
+    switch (chip)
+    {
+        case CMD_SONG_UPLOAD:
+            receiveSong();
+            return;
+
+        case CMD_SONG_PLAY:
+            if (Serial.readBytes((char*)buffer, 1) == 1)
+                playSong(buffer[0]);
+            return;
+
+        case CMD_SONG_STOP:
+            stopSong();
+            return;
+
+        case CMD_PROFILE:
+            if (Serial.readBytes((char*)buffer, 1) == 1)
+                profileCommand(buffer[0]);
+            return;
+
+        case CMD_BUS_BENCHMARK:
+            busBenchmark();
+            return;
+
+        case CMD_STREAM_BENCHMARK:
+            streamBenchmark();
+            return;
+
+        case CMD_PCM_START:
+            if (Serial.readBytes((char*)buffer, 4) == 4)
+                startPcm(buffer[0] | (buffer[1] << 8), buffer[2] | (buffer[3] << 8));
+            return;
 
-    size_t bytesRead = Serial.readBytes((char*)buffer, packetSize);
+        case CMD_PCM_DATA:
+            if (Serial.readBytes((char*)buffer, 1) == 1)
+                receivePcm(buffer[0]);
+            return;
+
+        case CMD_PCM_STOP:
+            stopPcm(true);
+            return;
+    }
+
+    if (chip > ALL_CHIPS)
+        return;
+
+    // The host is streaming again
+    if (songPlaying || pcmPlaying)
+        stopSong();
+
+    size_t length = chip == ALL_CHIPS ? FRAME_SIZE * 3 : FRAME_SIZE;
+    size_t bytesRead = Serial.readBytes((char*)buffer + 1, length);
 
     /* static bool played = false;
     if (!played) {
-        // Compute tone period for 440 Hz
+        // Compute tone period for 440 Hz
         uint16_t period = 2000000 / (16 * 440);
 
         // Once only (e.g., setup):
@@ -90,35 +267,570 @@ void YMPlayerSerialClass::update()
 
     //return;
 
-    if (bytesRead == packetSize)
+    if (bytesRead != length)
+        return;
+
+    const uint8_t *regs = buffer + 1;
+
+    if (chip == ALL_CHIPS)
+    {
+        commitAll(regs);
+        return;
+    }
+
+    Ym.setLED(chip, !Ym.getLED(chip));
+
+    // Send register data
+    for (int i = 0; i < 14; i++)
+        Ym.queue(chip, i, regs[i] & regMask[i]);
+    Ym.flush();
+
+    //static bool tick = false;
+    //tick = !tick;
+    //Ym.setVolume(0, 0, tick ? 0x0F : 0x00);
+    //Ym.setVolume(0, 1, tick ? 0x0F : 0x00);
+    //Ym.setVolume(0, 2, tick ? 0x0F : 0x00);
+
+    EffectParams &fx = editEffects();
+    decodeEffect(fx, chip, regs, /*flagR*/1, /*timerR*/6,  /*countR*/14);
+    decodeEffect(fx, chip, regs, /*flagR*/3, /*timerR*/8,  /*countR*/15);
+    publishEffects();
+}
+
+// ──────────────────────────────────────────────────────────────────────────
+// Commit one frame for all three chips. The whole packet is already in
+// RAM, so the writes are queued back to back with no serial wait in
+// between, one chip at a time: three selects per frame instead of one
+// per write. The effects ISR sends them BUS_CHUNK (2) per 32 µs tick, so
+// the 42 writes take 21 ticks and chip 2 lands about 14 ticks (~450 µs)
+// after chip 0, the whole frame within ~670 µs; still well inside a
+// 20 ms frame. Writes the ring already holds delay it further.
+// ──────────────────────────────────────────────────────────────────────────
+void YMPlayerSerialClass::commitAll(const uint8_t regs[FRAME_SIZE * 3])
+{
+    for (uint8_t c = 0; c < 3; c++)
+        for (uint8_t i = 0; i < 14; i++)
+            Ym.queue(c, i, regs[c * FRAME_SIZE + i] & regMask[i]);
+    Ym.flush();
+
+    EffectParams &fx = editEffects();
+    for (uint8_t c = 0; c < 3; c++)
+    {
+        const uint8_t *chipRegs = regs + c * FRAME_SIZE;
+        Ym.setLED(c, !Ym.getLED(c));
+        decodeEffect(fx, c, chipRegs, /*flagR*/1, /*timerR*/6,  /*countR*/14);
+        decodeEffect(fx, c, chipRegs, /*flagR*/3, /*timerR*/8,  /*countR*/15);
+    }
+    publishEffects();
+}
+
+// ──────────────────────────────────────────────────────────────────────────
+// Autonomous playback
+// ──────────────────────────────────────────────────────────────────────────
+void YMPlayerSerialClass::receiveSong()
+{
+    stopSong();
+
+    uint8_t head[4];
+    if (Serial.readBytes((char*)head, 4) != 4)
+        return;
+
+    uint16_t length = head[0] | (head[1] << 8);
+    uint16_t loop   = head[2] | (head[3] << 8);
+
+    if (length > SONG_BUFFER_SIZE)
+    {
+        skip(length);
+        songLength = 0;
+        return;
+    }
+
+    if (Serial.readBytes((char*)song, length) != length || !checkSong(length, loop))
+    {
+        songLength = 0;
+        return;
+    }
+
+    songLength = length;
+    songLoop = loop;
+}
+
+// Walks the tokens once, so updateSong() can read them unchecked: true
+// when the song is whole tokens and loop is the start of one
+bool YMPlayerSerialClass::checkSong(uint16_t length, uint16_t loop) const
+{
+    bool loopFound = false;
+    uint16_t pos = 0;
+
+    while (pos < length)
+    {
+        if (pos == loop)
+            loopFound = true;
+
+        uint8_t token = song[pos++];
+        if (token & 0x80)
+            continue;
+        if (token & ~0x07)
+            return false;
+
+        for (uint8_t c = 0; c < 3; c++)
+        {
+            if (!(token & (1 << c)))
+                continue;
+            if (length - pos < 2)
+                return false;
+
+            uint16_t mask = song[pos] | (song[pos + 1] << 8);
+            pos += 2;
+            for (; mask; mask >>= 1)
+                pos += mask & 1;
+            if (pos > length)
+                return false;
+        }
+    }
+
+    return loopFound;
+}
+
+void YMPlayerSerialClass::playSong(uint8_t frameRate)
+{
+    stopSong();
+
+    // OCR3A is 16 bit, so clk/64 reaches down to 4 Hz at 16 MHz
+    if (!songLength || !frameRate || F_CPU / 64 / frameRate > 0x10000UL)
+        return;
+
+    songPos = 0;
+    songRepeat = 0;
+    memset(shadow, 0, sizeof(shadow));
+    songPlaying = true;
+
+    // Timer3 CTC, clk/64 = 250 kHz
+    noInterrupts();
+    TCCR3A = 0;
+    TCCR3B = _BV(WGM32) | _BV(CS31) | _BV(CS30);
+    OCR3A  = F_CPU / 64 / frameRate - 1;
+    TCNT3  = 0;
+    TIMSK3 = _BV(OCIE3A);
+    interrupts();
+}
+
+void YMPlayerSerialClass::stopSong()
+{
+    TIMSK3 = 0;
+    songPlaying = false;
+    stopPcm(false);
+    stopEffects();
+
+    for (uint8_t c = 0; c < 3; c++)
+        Ym.mute(c);
+}
+
+// Every SID and drum voice goes quiet from the effects ISR's next tick,
+// until a frame starts them again
+void YMPlayerSerialClass::stopEffects()
+{
+    EffectParams &fx = editEffects();
+    for (uint8_t c = 0; c < 3; c++)
+        for (uint8_t v = 0; v < 3; v++)
+        {
+            fx.sid[c][v].active = false;
+            fx.sid[c][v].level = 0;
+            fx.dd[c][v].held = false;
+        }
+    publishEffects();
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (uint8_t c = 0; c < 3; c++)
+            for (uint8_t v = 0; v < 3; v++)
+                for (uint8_t i = 0; i < DIGIDRUM_MIX; i++)
+                    dd[c][v].drum[i].active = false;
+    }
+}
+
+void YMPlayerSerialClass::profileCommand(uint8_t op)
+{
+    switch (op)
+    {
+        case 0:
+        {
+            effectsProfile.report();
+            songProfile.report();
+
+            // "selects n=2971 ms=1000", chip selects since the last report
+            uint32_t selects;
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                selects = Ym.selectCount;
+                Ym.selectCount = 0;
+            }
+            uint32_t now = millis();
+            Serial.print("selects n=");
+            Serial.print(selects);
+            Serial.print(" ms=");
+            Serial.println(now - lastProfileReport);
+            lastProfileReport = now;
+            break;
+        }
+        case 1:
+        {
+            // Chip 0 and chip 1 LEDs; IsrProfile drives its scope bit on PORTB
+            typedef YMPinAt<YM_BOARD::Leds, 0>::type EffectsLed;
+            typedef YMPinAt<YM_BOARD::Leds, 1>::type SongLed;
+            static_assert(YMSamePort<EffectsLed::port, YMPortB>::value &&
+                          YMSamePort<SongLed::port, YMPortB>::value,
+                          "scope LEDs must be on PORTB");
+            effectsProfile.setScopeBit(EffectsLed::mask);
+            songProfile.setScopeBit(SongLed::mask);
+            break;
+        }
+        case 2:
+            effectsProfile.setScopeBit(0);
+            songProfile.setScopeBit(0);
+            break;
+    }
+}
+
+// The benchmark drives the bus itself, so the effects ISR gives it up
+// for the run, once it has sent what is queued
+void YMPlayerSerialClass::busBenchmark()
+{
+    stopSong();
+
+    while (!Ym.busIdle())
+        yield();
+    TIMSK1 = 0;
+    Ym.setQueued(false);
+
+    Ym.benchmark();
+    resetChips();
+
+    Ym.setQueued(true);
+    TIMSK1 = _BV(OCIE1A);
+}
+
+// Swallows an upload that does not fit, so the stream stays in step
+void YMPlayerSerialClass::skip(uint16_t length)
+{
+    uint8_t buffer[FRAME_SIZE];
+    while (length)
+    {
+        uint8_t n = min(length, (uint16_t)FRAME_SIZE);
+        if (Serial.readBytes((char*)buffer, n) != n)
+            break;
+        length -= n;
+    }
+}
+
+// Decodes a YMStreamDecoder block uploaded into the song buffer and
+// prints the cycles per frame, counted on Timer1 at clk/1 with
+// interrupts off, and a sum of the decoded registers for the host to
+// check: "stream frames=500 bytes=1020 max=612 avg=388 sum=40211"
+void YMPlayerSerialClass::streamBenchmark()
+{
+    stopSong();
+    songLength = 0;         // the block overwrites the song
+
+    uint8_t head[4];
+    if (Serial.readBytes((char*)head, 4) != 4)
+        return;
+
+    uint16_t length = head[0] | (head[1] << 8);
+    uint16_t frames = head[2] | (head[3] << 8);
+
+    if (length > SONG_BUFFER_SIZE)
     {
-        uint8_t chip = buffer[0];
+        skip(length);
+        return;
+    }
+    if (Serial.readBytes((char*)song, length) != length)
+        return;
+
+    while (!Ym.busIdle())
+        yield();
+    TIMSK1 = 0;
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);     // normal mode, counts cycles
+
+    YMStreamDecoder decoder;
+    decoder.begin(song, length);
+
+    uint8_t regs[YMZ_STREAMS];
+    uint32_t total = 0;
+    uint16_t most = 0;
+    uint16_t sum = 0;
+
+    for (uint16_t f = 0; f < frames; f++)
+    {
+        uint16_t cycles;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            TCNT1 = 0;
+            decoder.decodeFrame(regs);
+            cycles = TCNT1;
+        }
+
+        total += cycles;
+        most = max(most, cycles);
+        for (uint8_t r = 0; r < YMZ_STREAMS; r++)
+            sum += regs[r];
+    }
+
+    startEffectsTimer();
+
+    Serial.print("stream frames=");
+    Serial.print(frames);
+    Serial.print(" bytes=");
+    Serial.print(length);
+    Serial.print(" max=");
+    Serial.print(most);
+    Serial.print(" avg=");
+    Serial.print(frames ? total / frames : 0);
+    Serial.print(" sum=");
+    Serial.println(sum);
+}
+
+// ──────────────────────────────────────────────────────────────────────────
+// PCM streaming: the host sends 4 bit levels, the effects ISR writes
+// one sample to every voice in the mask per period. The song buffer
+// is the ring, with two samples per byte.
+// ──────────────────────────────────────────────────────────────────────────
+void YMPlayerSerialClass::startPcm(uint16_t rate, uint16_t mask)
+{
+    stopSong();
+    songLength = 0;         // the ring overwrites it
+
+    mask &= 0x1FF;
+    uint8_t voices = 0;
+    for (uint16_t m = mask; m; m >>= 1)
+        voices += m & 1;
+    rate = constrain(rate, 1, PCM_MAX_RATE);
+
+    // stopSong() has stopped the effects, they stay quiet until the next frame
+
+    // Tone and noise off, so a voice outputs its level alone
+    for (uint8_t c = 0; c < 3; c++)
+        if ((mask >> (c * 3)) & 7)
+            Ym.setMixer(c, 0b00111111);
+
+    pcmRate = rate;
+    pcmMask = mask;
+    pcmVoices = voices;
+    pcmPhase = 0;
+    pcmFrames = 0;
+    pcmUnderruns = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pcmHead = 0;
+        pcmTail = 0;
+    }
+
+    pcmStarted = millis();
+    pcmPlaying = voices != 0;
+
+    // "pcm rate=8000 voices=9", what the device plays
+    Serial.print("pcm rate=");
+    Serial.print(rate);
+    Serial.print(" voices=");
+    Serial.println(voices);
+}
+
+// Reads straight into the ring. While it is full this waits for the
+// ISR to drain it, and the host waits on USB flow control meanwhile.
+void YMPlayerSerialClass::receivePcm(uint8_t length)
+{
+    while (length)
+    {
+        if (!pcmPlaying)
+        {
+            // Not streaming, swallow it so the stream stays in step
+            uint8_t skip[FRAME_SIZE];
+            uint8_t n = min(length, FRAME_SIZE);
+            if (Serial.readBytes((char*)skip, n) != n)
+                return;
+            length -= n;
+            continue;
+        }
+
+        uint16_t head = pcmHead;
+        uint16_t fill;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            fill = head - pcmTail;
+        }
+
+        uint16_t room = (PCM_NIBBLES - fill) >> 1;
+        if (!room)
+        {
+            yield();
+            continue;
+        }
 
-        if (chip > 2)
+        uint16_t at = (head >> 1) & (SONG_BUFFER_SIZE - 1);
+        uint8_t n = min(min((uint16_t)length, room), (uint16_t)(SONG_BUFFER_SIZE - at));
+        if (Serial.readBytes((char*)song + at, n) != n)
             return;
 
-        Ym.setLED(chip, !Ym.getLED(chip));
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            pcmHead = head + n * 2;
+        }
+        length -= n;
+    }
+}
+
+void YMPlayerSerialClass::stopPcm(bool report)
+{
+    bool playing = pcmPlaying;
+    pcmPlaying = false;
+
+    if (playing)
+        for (uint8_t c = 0; c < 3; c++)
+            Ym.mute(c);
+
+    if (!report)
+        return;
+
+    // "pcm frames=80000 underruns=0 ms=10000", samples written to every
+    // voice and samples that fell due with the ring empty
+    Serial.print("pcm frames=");
+    Serial.print(pcmFrames);
+    Serial.print(" underruns=");
+    Serial.print(pcmUnderruns);
+    Serial.print(" ms=");
+    Serial.println(playing ? millis() - pcmStarted : 0);
+}
+
+// Effects ISR. A sample that falls due with the ring empty is lost
+// and counted, so the stream keeps its rate.
+void YMPlayerSerialClass::playPcm()
+{
+    pcmPhase += pcmRate;
+    if (pcmPhase < ISR_RATE_HZ)
+        return;
+    pcmPhase -= ISR_RATE_HZ;
+
+    uint16_t tail = pcmTail;
+    if ((uint16_t)(pcmHead - tail) < pcmVoices)
+    {
+        pcmUnderruns++;
+        return;
+    }
+
+    uint16_t mask = pcmMask;
+    for (uint8_t c = 0; c < 3; c++)
+    {
+        if (!(mask & 7))
+        {
+            mask >>= 3;
+            continue;
+        }
+
+        Ym.select(c);
+        for (uint8_t v = 0; v < 3; v++, mask >>= 1)
+        {
+            if (!(mask & 1))
+                continue;
+
+            uint8_t pair = song[(tail >> 1) & (SONG_BUFFER_SIZE - 1)];
+            Ym.writeFast(YM2149::REG_A_LEVEL + v, tail & 1 ? pair >> 4 : pair & 0x0F);
+            tail++;
+        }
+    }
+
+    pcmTail = tail;
+    pcmFrames++;
+}
+
+void YMPlayerSerialClass::updateSong()
+{
+    if (!songPlaying)
+        return;
+
+    if (songRepeat)
+    {
+        songRepeat--;
+    }
+    else
+    {
+        uint8_t token = song[songPos++];
+
+        if (token & 0x80)
+        {
+            songRepeat = token & 0x7F;
+        }
+        else
+        {
+            for (uint8_t c = 0; c < 3; c++)
+            {
+                if (!(token & (1 << c)))
+                    continue;
+
+                uint16_t mask = song[songPos] | (song[songPos + 1] << 8);
+                songPos += 2;
+
+                for (uint8_t r = 0; r < FRAME_SIZE; r++, mask >>= 1)
+                {
+                    if (!(mask & 1))
+                        continue;
+
+                    uint8_t value = song[songPos++];
+                    shadow[c][r] = value;
+                    if (r < 14)
+                        Ym.write(c, r, value & regMask[r]);
+                }
+            }
+        }
 
-        const uint8_t *regs = buffer + 1;
+        if (songPos >= songLength)
+            songPos = songLoop;
+    }
 
-        // Send register data
-        for (int i = 0; i < 14; i++)
-            Ym.write(chip, i, regs[i] & regMask[i]);
+    EffectParams &fx = editEffects();
+    for (uint8_t c = 0; c < 3; c++)
+    {
+        decodeEffect(fx, c, shadow[c], /*flagR*/1, /*timerR*/6,  /*countR*/14);
+        decodeEffect(fx, c, shadow[c], /*flagR*/3, /*timerR*/8,  /*countR*/15);
+    }
+    publishEffects();
+}
 
-        //static bool tick = false;
-        //tick = !tick;
-        //Ym.setVolume(0, 0, tick ? 0x0F : 0x00);
-        //Ym.setVolume(0, 1, tick ? 0x0F : 0x00);
-        //Ym.setVolume(0, 2, tick ? 0x0F : 0x00);
+// Level for a voice with drums playing: the drums and the SID square
+// summed as amplitudes and mapped back to the chip's log scale. A
+// sample's top nibble is its level, as in ST-Sound, so one drum alone
+// plays exactly those levels and rests at 8 (0x80) as it always did.
+// The rest amplitude is counted once, so drums at rest do not add up
+// to a louder voice. False when no drum plays.
+static constexpr uint8_t DRUM_REST_LEVEL = 0x80 >> 4;
 
-        decodeEffect(chip, regs, /*flagR*/1, /*timerR*/6,  /*countR*/14);
-        decodeEffect(chip, regs, /*flagR*/3, /*timerR*/8,  /*countR*/15);
+static inline bool drumLevel(const DigiDrumVoice &dv, const SidState &s, uint8_t &level)
+{
+    const int16_t rest = pgm_read_byte(&ymAmplitude[DRUM_REST_LEVEL]);
+    int16_t sum = rest;
+    bool playing = false;
+
+    for (uint8_t i = 0; i < DIGIDRUM_MIX; ++i) {
+        const DigiDrumState &d = dv.drum[i];
+        if (d.active) {
+            sum += pgm_read_byte(&ymAmplitude[pgm_read_byte(d.pos) >> 4]) - rest;
+            playing = true;
+        }
     }
+    if (!playing)
+        return false;
+
+    if (s.active && s.toggle)
+        sum += pgm_read_byte(&ymAmplitude[s.level]);
+
+    level = pgm_read_byte(&ymLevel[constrain(sum, 0, 255)]);
+    return true;
 }
 
 /* -----------------------------------------------------------------------
  * updateEffects()
- *  • Called from the Timer‑1 ISR
+ *  • Called from the Timer‑1 ISR, which owns the YM bus
  *  • Keeps SID‑Voice and Digi‑Drum running between serial frames
  *  • Works in two modes:
  *        USE_BATCH_ISR == 0  →  4 µs interrupt, touch bus every call
@@ -126,36 +838,57 @@ void YMPlayerSerialClass::update()
  * -------------------------------------------------------------------- */
 void YMPlayerSerialClass::updateEffects()
 {
+    // Queued register writes first, so effect writes win within a tick
+    Ym.service();
+
+    uint8_t seq = effectSeq;
+    if (seq != effectSeen) {
+        effectSeen = seq;
+        loadEffects();
+    }
+
+    // PCM streaming owns the level registers
+    if (pcmPlaying) {
+        playPcm();
+        return;
+    }
+
 #if USE_BATCH_ISR == 0                 // ========= 4 µs ISR =========
 
-    // loop over all chips / voices every 4 µs -----------------------
+    // loop over all chips / voices every 4 µs -----------------------
     for (uint8_t c = 0; c < 3; ++c) {
-        // select chip once
-        if (c != Ym.currentChip) {
-            Ym.selectYM(c);
-            Ym.currentChip = c;
-        }
-
         for (uint8_t v = 0; v < 3; ++v) {
+            bool changed = false;
+
             //  -------- SID Voice --------
             SidState &s = sid[c][v];
             if (s.active && --s.phase == 0) {
                 s.phase  = s.reload;
                 s.toggle ^= 1;
-                Ym.writeFast(YM2149::REG_A_LEVEL + v,
-                                     s.toggle ? s.level : 0);
+                changed = true;
+            }
+
+            //  -------- Digi‑Drums --------
+            DigiDrumVoice &dv = dd[c][v];
+            for (uint8_t i = 0; i < DIGIDRUM_MIX; ++i) {
+                DigiDrumState &d = dv.drum[i];
+                if (!d.active || --d.phase) continue;
+
+                d.phase = d.reload;
+                if (++d.pos == d.end) d.active = false;
+                changed = true;
             }
 
-            //  -------- Digi‑Drum --------
-            DigiDrumState &d = dd[c][v];
-            if (!d.active) continue;
-            if (--d.phase) continue;
+            if (!changed) continue;
 
-            d.phase = d.reload;
-            uint8_t sampleByte = sampleAddress[d.sample][d.pos++];
-            if (d.pos >= sampleLen[d.sample]) d.active = false;
+            uint8_t level;
+            if (!drumLevel(dv, s, level)) {
+                if (!s.active) continue;
+                level = s.toggle ? s.level : 0;
+            }
 
-            Ym.writeFast(YM2149::REG_A_LEVEL + v, sampleByte & 0x0F);
+            Ym.select(c);
+            Ym.writeFast(YM2149::REG_A_LEVEL + v, level);
         }
     }
 
@@ -170,13 +903,15 @@ void YMPlayerSerialClass::updateEffects()
                 else { s.phase += s.reload - TICKS_ISR; s.toggle ^= 1; }
             }
 
-            DigiDrumState &d = dd[c][v];
-            if (d.active) {
+            DigiDrumVoice &dv = dd[c][v];
+            for (uint8_t i = 0; i < DIGIDRUM_MIX; ++i) {
+                DigiDrumState &d = dv.drum[i];
+                if (!d.active) continue;
+
                 if (d.phase > TICKS_ISR) d.phase -= TICKS_ISR;
                 else {
-                    d.phase = d.reload;
-                    ++d.pos;
-                    if (d.pos >= sampleLen[d.sample]) d.active = false;
+                    d.phase += d.reload - TICKS_ISR;    // reload >= TICKS_ISR
+                    if (++d.pos == d.end) d.active = false;
                 }
             }
         }
@@ -185,30 +920,20 @@ void YMPlayerSerialClass::updateEffects()
     static uint8_t slice = 0;               // 0‑7  (advances each ISR)
 
     for (uint8_t c = 0; c < 3; ++c) {
-        // ---- change chip only when we really have to ------------
-        if (c != Ym.currentChip) {
-            Ym.selectYM(c);
-            Ym.currentChip = c;
-        }
-
+        // chips are selected only for a write, idle ones cost nothing
         for (uint8_t v = 0; v < 3; ++v) {
             if (((c * 3 + v) & 7) != slice) continue;   // not this 4‑µs slot
 
-            //  ---- SID write (takes priority over DD) -------------
+            //  ---- drums mixed with the SID square, or SID alone ----
             SidState &s = sid[c][v];
-            if (s.active) {
-                Ym.writeFast(YM2149::REG_A_LEVEL + v,
-                                     s.toggle ? s.level : 0);
-                continue;   // DD uses same register – skip this slot
+            uint8_t level;
+            if (!drumLevel(dd[c][v], s, level)) {
+                if (!s.active) continue;
+                level = s.toggle ? s.level : 0;
             }
 
-            // ---- Digi‑Drum write --------------------------------
-            DigiDrumState &d = dd[c][v];
-            if (d.active) {
-                uint8_t sampleByte = sampleAddress[d.sample][d.pos];
-                Ym.writeFast(YM2149::REG_A_LEVEL + v,
-                                     sampleByte & 0x0F);
-            }
+            Ym.select(c);
+            Ym.writeFast(YM2149::REG_A_LEVEL + v, level);
         }
     }
     slice = (slice + 1) & 0x07;             // next 4‑µs sub‑slot
@@ -5,24 +5,70 @@
 
 #include "Arduino.h"
 #include "YM2149.h"
+#include "IsrProfile.h"
 
+// Working state of the effect voices. Only the effects ISR touches
+// it (stopEffects() stops the drums with interrupts off), so nothing
+// here is volatile; decodeEffect() reaches it through EffectParams
+// below.
 struct SidState {
-    volatile bool     active  = false;
-    volatile uint8_t  level   = 0;     // 0‑15
-    volatile uint16_t reload  = 0;     // ticks of   4 µs
-    volatile uint16_t phase   = 0;     // countdown  4 µs
-    volatile uint8_t  toggle  = 0;     // 0 / 1
+    bool     active  = false;
+    uint8_t  level   = 0;     // 0‑15
+    uint16_t reload  = 0;     // ticks of   4 µs
+    uint16_t phase   = 0;     // countdown  4 µs
+    uint8_t  toggle  = 0;     // 0 / 1
+    uint8_t  start   = 0;     // SidParams::start last applied
 };
 extern SidState sid[3][3];
 
 struct DigiDrumState {
-    volatile bool     active  = false;
-    volatile uint16_t reload  = 0;      // 4 µs ticks
-    volatile uint16_t phase   = 0;      // countdown (4 µs)
-    volatile uint16_t pos     = 0;      // sample cursor
-    volatile uint8_t  sample  = 0;      // sample # 0‑31
+    bool     active  = false;
+    uint16_t reload  = 0;      // 4 µs ticks
+    uint16_t phase   = 0;      // countdown (4 µs)
+    const uint8_t *pos = nullptr;   // next sample byte, in flash
+    const uint8_t *end = nullptr;   // one past the last
+};
+
+// ----------------------------------------------------------
+// Drums mixed per voice. A new drum takes a free slot, or the
+// one nearest its end, and the voice's drums and SID square
+// are summed as amplitudes into the one level write the
+// voice gets per tick (see ymLevel). 1 = a new drum cuts the
+// previous one. Each slot costs 9 bytes of RAM per voice.
+// ----------------------------------------------------------
+#define DIGIDRUM_MIX    2
+
+struct DigiDrumVoice {
+    DigiDrumState drum[DIGIDRUM_MIX];
+    uint8_t  last    = 0;      // slot of the newest drum
+    uint8_t  start   = 0;      // DigiDrumParams::start last applied
+};
+extern DigiDrumVoice dd[3][3];
+
+// Effect parameters as the last frame decoded them. start counts
+// (re)starts: when it changes the ISR resets the voice's phase,
+// otherwise it only takes the new values.
+struct SidParams {
+    bool     active  = false;
+    uint8_t  level   = 0;     // the frame's volume while inactive
+    uint16_t reload  = 0;
+    uint8_t  start   = 0;
+};
+
+struct DigiDrumParams {
+    bool     held    = false;  // this frame names a drum
+    bool     replace = false;  // the same the frame before named: restart it in place
+    uint8_t  sample  = 0;
+    uint16_t reload  = 0;
+    const uint8_t *begin = nullptr; // sample in flash
+    const uint8_t *end   = nullptr;
+    uint8_t  start   = 0;
+};
+
+struct EffectParams {
+    SidParams      sid[3][3];
+    DigiDrumParams dd[3][3];
 };
-extern DigiDrumState dd[3][3];
 
 // ----------------------------------------------------------
 // Fast-SID ISR – choose ONE:
@@ -39,6 +85,7 @@ extern DigiDrumState dd[3][3];
     constexpr uint8_t  ISR_PERIOD_US  = 4;
     constexpr uint8_t  TICKS_ISR      = 1;
 #endif
+constexpr uint32_t ISR_RATE_HZ = 1000000UL / ISR_PERIOD_US;     // effects ticks per second
 
 enum class EffectType : uint8_t {
     None        = 255,
@@ -48,18 +95,139 @@ enum class EffectType : uint8_t {
     SyncBuzzer  = 3
 };
 
+// ----------------------------------------------------------
+// Autonomous playback: the host uploads a song and the
+// device plays it from RAM off Timer3, looping forever.
+//
+//   0x10 len16 loop16 <len bytes>   upload (stops playback)
+//   0x11 rate                       play at rate frames/s
+//   0x12                            stop
+//   0x13 op                         ISR profile: 0 report ISR
+//                                   cycles and chip selects and
+//                                   reset, 1 scope pins on
+//                                   (effects LED 0, song LED 1),
+//                                   2 scope pins off
+//   0x14                            bus benchmark (stops playback),
+//                                   see YM2149::benchmark
+//   0x15 rate16 mask16              PCM streaming: rate samples/s
+//                                   (clamped to PCM_MAX_RATE) on the
+//                                   voices in mask, bit chip * 3 +
+//                                   voice. Answers "pcm rate= voices=".
+//                                   Stops playback and takes the song
+//                                   buffer as its ring
+//   0x16 len <len bytes>            PCM data: per sample one level
+//                                   nibble per voice, in mask order,
+//                                   low nibble first. Waits while the
+//                                   ring is full, USB flow control
+//                                   holds the host back
+//   0x17                            PCM stop, answers "pcm frames=
+//                                   underruns= ms="
+//
+// The song is a stream of frame tokens, 16 bit values are
+// little endian:
+//   1rrrrrrr                repeat the previous frame r+1 times
+//   00000ccc {mask16 regs}  chips in ccc change, each gives a
+//                           register mask then the new values
+// loop is the byte offset of the loop frame, which the host
+// encodes with every register so it is a valid restart point.
+// ----------------------------------------------------------
+constexpr uint16_t SONG_BUFFER_SIZE = 1024;
+
 class YMPlayerSerialClass {
   public:
     YMPlayerSerialClass() {};
 
-    void begin();
+    void begin();           // starts the effects timer
     void update();
-    void updateEffects();
+    void updateEffects();   // Timer1 ISR, the only caller that drives the bus
+    void updateSong();      // Timer3 ISR, one frame per call
+
+    static const uint8_t FRAME_SIZE = 16;   // registers per chip in a packet
+    static const uint8_t ALL_CHIPS = 3;     // packet header: one frame for every chip
+
+    static const uint8_t CMD_SONG_UPLOAD = 0x10;
+    static const uint8_t CMD_SONG_PLAY = 0x11;
+    static const uint8_t CMD_SONG_STOP = 0x12;
+    static const uint8_t CMD_PROFILE = 0x13;
+    static const uint8_t CMD_BUS_BENCHMARK = 0x14;
+    static const uint8_t CMD_PCM_START = 0x15;
+    static const uint8_t CMD_PCM_DATA = 0x16;
+    static const uint8_t CMD_PCM_STOP = 0x17;
+    static const uint8_t CMD_STREAM_BENCHMARK = 0x18;
+
+    // One PCM sample writes every voice in the mask, all in the tick
+    // it falls due, so at most every other tick
+    static constexpr uint16_t PCM_MAX_RATE = ISR_RATE_HZ / 2 < 16000 ? ISR_RATE_HZ / 2 : 16000;
+    static constexpr uint16_t PCM_NIBBLES = SONG_BUFFER_SIZE * 2;
+
+    static const uint8_t SID_RESTART = 0x40;    // r1 bit 6: restart the SID voice
+
+    IsrProfile effectsProfile;
+    IsrProfile songProfile;
 
   private:
     YM2149 Ym;
 
-    void decodeEffect(uint8_t chip,
+    void resetChips();
+    void startEffectsTimer();
+    void commitAll(const uint8_t regs[FRAME_SIZE * 3]);
+
+    void receiveSong();
+    bool checkSong(uint16_t length, uint16_t loop) const;
+    void playSong(uint8_t frameRate);
+    void stopSong();
+    void stopEffects();
+    void profileCommand(uint8_t op);
+    void busBenchmark();
+    void streamBenchmark();
+    void skip(uint16_t length);
+    uint32_t lastProfileReport = 0;
+
+    uint8_t song[SONG_BUFFER_SIZE];
+    uint16_t songLength = 0;
+    uint16_t songLoop = 0;
+    uint16_t songPos = 0;
+    uint8_t songRepeat = 0;
+    volatile bool songPlaying = false;
+    uint8_t shadow[3][FRAME_SIZE];          // last registers played, for effects
+
+    // PCM streaming, in song[]. The head and tail count nibbles and
+    // run freely, so head - tail is the fill; the main loop moves the
+    // head, the effects ISR the tail.
+    void startPcm(uint16_t rate, uint16_t mask);
+    void receivePcm(uint8_t length);
+    void stopPcm(bool report);
+    void playPcm();                         // effects ISR
+    volatile bool pcmPlaying = false;
+    volatile uint16_t pcmHead = 0;
+    volatile uint16_t pcmTail = 0;
+    uint16_t pcmRate = 0;
+    uint16_t pcmMask = 0;
+    uint8_t pcmVoices = 0;
+    uint32_t pcmPhase = 0;                  // effects ISR while playing
+    uint32_t pcmFrames = 0;                 // samples played
+    uint32_t pcmUnderruns = 0;              // samples due with the ring empty
+    uint32_t pcmStarted = 0;                // millis()
+
+    // Effect parameter handoff, double buffered. The writer (main
+    // loop, or the song ISR while a song plays; never both) gets the
+    // back buffer from editEffects(), a copy of the published one,
+    // decodes a frame into it and publishes it with publishEffects(),
+    // a single byte store to effectSeq. updateEffects() loads the
+    // published buffer into sid/dd when effectSeq moves. The writer
+    // never touches the published buffer and cannot interrupt the
+    // effects ISR, so the ISR always sees a whole frame, never a new
+    // reload with an old phase.
+    EffectParams effectParams[2];
+    volatile uint8_t effectSeq = 0;     // effectParams[effectSeq & 1] is published
+    uint8_t effectSeen = 0;             // effects ISR only
+
+    EffectParams &editEffects();
+    void publishEffects();
+    void loadEffects();
+
+    void decodeEffect(EffectParams &fx,
+                      uint8_t chip,
                       const uint8_t regs[16],
                       uint8_t flagR,
                       uint8_t timerR,
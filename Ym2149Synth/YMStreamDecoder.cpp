@@ -0,0 +1,64 @@
+// benbaker76 (https://github.com/benbaker76)
+
+#include "YMStreamDecoder.h"
+
+void YMStreamDecoderClass::begin(const uint8_t * b, uint16_t s, bool p)
+{
+    block = b;
+    size = s;
+    progmem = p;
+
+    for (uint8_t i = 0; i < YMZ_STREAMS; i++)
+    {
+        Stream &st = streams[i];
+        st.pos = read(i * 2) | (read(i * 2 + 1) << 8);
+        st.ret = 0;
+        st.count = 0;
+        st.last = 0;
+    }
+}
+
+uint8_t YMStreamDecoderClass::read(uint16_t p) const
+{
+    if (p >= size)
+        return 0;
+    return progmem ? pgm_read_byte(block + p) : block[p];
+}
+
+void YMStreamDecoderClass::decodeFrame(uint8_t regs[YMZ_STREAMS])
+{
+    for (uint8_t i = 0; i < YMZ_STREAMS; i++)
+    {
+        Stream &st = streams[i];
+
+        if (!(st.count & ~LITERAL))
+        {
+            if (st.ret)
+            {
+                st.pos = st.ret;
+                st.ret = 0;
+            }
+
+            uint8_t token = read(st.pos++);
+
+            if (token & 0x80)
+            {
+                uint16_t back = read(st.pos) | (read(st.pos + 1) << 8);
+                st.pos += 2;
+                st.ret = st.pos;
+                st.pos -= back;
+                st.count = LITERAL | ((token & 0x7F) + YMZ_MIN_REPLAY);
+            }
+            else
+            {
+                st.count = (token & 0x40 ? LITERAL : 0) | ((token & 0x3F) + 1);
+            }
+        }
+
+        if (st.count & LITERAL)
+            st.last = read(st.pos++);
+
+        st.count--;
+        regs[i] = st.last;
+    }
+}
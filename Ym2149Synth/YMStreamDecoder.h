@@ -0,0 +1,60 @@
+// benbaker76 (https://github.com/benbaker76)
+
+#ifndef YMStreamDecoder_h
+#define YMStreamDecoder_h
+
+#include "Arduino.h"
+
+// ----------------------------------------------------------
+// Per-register stream decoder for compressed YM frames.
+//
+// A chip's song is 16 independent byte streams, one per
+// register, each compressed on its own (register-major, the
+// way YM files interleave). Header: 16 little endian
+// uint16 offsets from the start of the block to each stream.
+//
+// Stream tokens:
+//   00nnnnnn               previous value, n+1 frames
+//   01nnnnnn <n+1 bytes>   literal values, one per frame
+//   1nnnnnnn <lo> <hi>     n+4 values (127 at most) read
+//                          again from the literal bytes
+//                          d = hi:lo bytes before the end
+//                          of this token
+//
+// The decoder keeps no history: a replay reads the block
+// itself, so the state is 6 bytes per register and the
+// block stays where it was uploaded (RAM) or stored
+// (PROGMEM). decodeFrame() advances every stream by one
+// value, reading at most a token and a value per register,
+// so a frame costs a bounded number of cycles whatever the
+// data. Reads past the block give 0.
+// ----------------------------------------------------------
+constexpr uint8_t YMZ_STREAMS = 16;
+constexpr uint8_t YMZ_MIN_REPLAY = 4;
+
+class YMStreamDecoderClass {
+  public:
+    void begin(const uint8_t * block, uint16_t size, bool progmem = false);
+    void decodeFrame(uint8_t regs[YMZ_STREAMS]);
+
+  private:
+    static const uint8_t LITERAL = 0x80;    // in count: values come from the block
+
+    struct Stream {
+        uint16_t pos;       // next byte of the stream
+        uint16_t ret;       // where a replay returns to, 0 outside one
+        uint8_t  count;     // values left in the token, LITERAL flag
+        uint8_t  last;      // the register's current value
+    };
+
+    uint8_t read(uint16_t p) const;
+
+    const uint8_t * block;
+    uint16_t size;
+    bool progmem;
+    Stream streams[YMZ_STREAMS];
+};
+
+typedef YMStreamDecoderClass YMStreamDecoder;
+
+#endif
@@ -0,0 +1,14 @@
+// benbaker76 (https://github.com/benbaker76)
+
+#pragma once
+
+#include <Arduino.h>
+
+// The YM2149 level DAC is logarithmic, about 3 dB per step. Sums of
+// sounds have to be taken as amplitudes and converted back.
+//   ymAmplitude[level]  level 0-15 to amplitude 0-255
+//   ymLevel[amplitude]  amplitude 0-255 to the nearest level (the
+//                       boundaries are geometric means), so
+//                       ymLevel[ymAmplitude[l]] == l
+extern const uint8_t ymAmplitude[16] PROGMEM;
+extern const uint8_t ymLevel[256] PROGMEM;
@@ -33,7 +33,6 @@
 //#include "MidiDeviceSerial.h"
 //#include "SynthController.h"
 #include "YMPlayerSerial.h"
-#include "UpdateEffects.h"
 
 //SynthController synth;
 
@@ -64,23 +63,26 @@ void updateEffectsTimer()
 ISR(TIMER1_COMPA_vect) //, ISR_NAKED)
 {
 #ifdef YMPLAYER
+    ymPlayer.effectsProfile.enter();
     ymPlayer.updateEffects();
+    ymPlayer.effectsProfile.exit();
     //asm volatile("rjmp updateEffects");
     //updateEffects();
     //asm volatile ("reti");
 #endif
 }
 
-void initEffectsTimer()
+#ifdef YMPLAYER
+// Song frames for autonomous playback. Nested so the effects timer
+// keeps its 32 µs cadence; the frame's writes go into the bus ring
+// that the effects ISR drains.
+ISR(TIMER3_COMPA_vect, ISR_NOBLOCK)
 {
-    noInterrupts();
-    TCCR1A = 0;              // Reset timer mode
-    TCCR1B = _BV(WGM12);     // CTC mode
-    OCR1A  = F_CPU/1000000 * ISR_PERIOD_US - 1;
-    TIMSK1 = _BV(OCIE1A);    // Enable Compare‑Match A interrupt
-    TCNT1  = 0;              // Reset counter
-    interrupts();
+    ymPlayer.songProfile.enter();
+    ymPlayer.updateSong();
+    ymPlayer.songProfile.exit();
 }
+#endif
 
 /* void updateSoftSynth()
 {
@@ -95,11 +97,10 @@ void updateEvents()
 void setup()
 {
 #ifdef YMPLAYER
-    ymPlayer.begin();
+    ymPlayer.begin();       // also starts Timer1 for TIMER1_COMPA_vect
 
     //Timer1.initialize(ISR_PERIOD_US);
     //Timer1.attachInterrupt(updateEffectsTimer);
-    //initEffectsTimer();
 #else
     synth.setChannels(1, 2, 3);
     synth.begin();
@@ -125,6 +126,7 @@ void loop()
 #else
 #ifndef BENCHMARK
     midi.update();
+    synth.update();
 
     // Handle events every 1ms
     static unsigned long lastEventTime = 0;